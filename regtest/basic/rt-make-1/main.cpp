@@ -7,7 +7,7 @@
 
 using namespace PLMD;
 
-int run(int boxtype,double* av_nshifts=NULL){
+int run(int boxtype,double* av_nshifts=NULL,int* batch_failures=NULL){
   Random r;
   int failures=0;
   r.setSeed(-20);
@@ -77,6 +77,7 @@ int run(int boxtype,double* av_nshifts=NULL){
 
     Pbc pbc;
     pbc.setBox(box);
+    std::vector<Vector> batch,reference;
     for(int j=0;j<nvec;j++){
 // random vector
       Vector v(r.U01()-0.5,r.U01()-0.5,r.U01()-0.5);
@@ -90,7 +91,12 @@ int run(int boxtype,double* av_nshifts=NULL){
       pbc.fullSearch(full);
 // compare
       if(std::fabs(modulo2(fast)-modulo2(full))>1e-15) failures++;
+      batch.push_back(v);
+      reference.push_back(fast);
     }
+// batched version should give exactly the same vectors
+    pbc.apply(batch);
+    if(batch_failures) for(int j=0;j<nvec;j++) if(modulo2(batch[j]-reference[j])>0.0) (*batch_failures)++;
   }
   if(av_nshifts) *av_nshifts=double(nshifts)/double(nbox*nvec);
   return failures;
@@ -104,9 +110,11 @@ int main(){
   ofs<<std::fixed;
   for(unsigned type=0;type<6;type++){
     double nsh;
-    int err=run(type,&nsh);
+    int batcherr=0;
+    int err=run(type,&nsh,&batcherr);
     ofs<<"Box type "<<type<<"\n";
     ofs<<"Failures "<<err<<"\n";
+    ofs<<"Batch failures "<<batcherr<<"\n";
     ofs.precision(1);
     ofs<<"Shifts   "<<nsh<<"\n\n";
   }
@@ -0,0 +1,18 @@
+# This is the script I used to generate trajectory.xyz
+# I leave it here as a reference, but it is not necessary to run it
+# 300 atoms randomly placed in a triclinic box, then randomly displaced
+awk -v natoms=300 -v nframes=20 'BEGIN{
+  srand(1234);
+  a[1]=4.0; a[2]=0.0; a[3]=0.0;
+  b[1]=1.0; b[2]=4.0; b[3]=0.0;
+  c[1]=0.5; c[2]=1.0; c[3]=4.0;
+  for(i=1;i<=natoms;i++) for(s=1;s<=3;s++) x[i,s]=(rand()-0.5)*a[s]+(rand()-0.5)*b[s]+(rand()-0.5)*c[s];
+  for(f=1;f<=nframes;f++){
+    print natoms
+    print a[1],a[2],a[3],b[1],b[2],b[3],c[1],c[2],c[3]
+    for(i=1;i<=natoms;i++){
+      for(s=1;s<=3;s++) x[i,s]+=0.1*(rand()-0.5);
+      printf("Ar %.4f %.4f %.4f\n",x[i,1],x[i,2],x[i,3]);
+    }
+  }
+}' > trajectory.xyz
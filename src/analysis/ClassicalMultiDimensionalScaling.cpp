@@ -65,6 +65,22 @@ CLASSICAL_MDS ...
 ... CLASSICAL_MDS
 \endplumedfile
 
+By default the full matrix of squared distances is stored and diagonalized.  When you have a large number of frames
+this is expensive both in terms of memory and time.  The following input finds only the two eigenvectors that are
+required using subspace iteration.  In addition, because the LOWMEM flag is used, the squared distances are recalculated
+each time they are required rather than being stored so the memory required only grows linearly with the number of frames.
+
+\plumedfile
+CLASSICAL_MDS ...
+  ATOMS=1-256
+  METRIC=OPTIMAL-FAST
+  NLOW_DIM=2
+  EIGENSOLVER=ITERATIVE
+  LOWMEM
+  OUTPUT_FILE=rmsd-embed
+... CLASSICAL_MDS
+\endplumedfile
+
 The following section is for people who are interested in how this method works in detail. A solid understanding of this material is
 not necessary to use MDS.
 
@@ -155,7 +171,10 @@ we can use this decomposition to write:
 
 Much as in PCA there are generally a small number of large eigenvalues in \f$\Lambda\f$ and many small eigenvalues.
 We can safely use only the large eigenvalues and their corresponding eigenvectors to express the relationship between
-the coordinates \f$\mathbf{X}\f$.  This gives us our set of low-dimensional projections.
+the coordinates \f$\mathbf{X}\f$.  This gives us our set of low-dimensional projections.  When EIGENSOLVER=ITERATIVE is used
+only these large eigenvalues are computed.  A set of vectors that is slightly larger than NLOW_DIM is repeatedly multiplied by
+\f$-\frac{1}{2} \mathbf{J} \mathbf{D}^2 \mathbf{J}\f$ and orthonormalized until the residuals of the NLOW_DIM eigenvectors with the
+largest eigenvalues are small.  The centering is applied on the fly so the matrix \f$\mathbf{J} \mathbf{D}^2 \mathbf{J}\f$ is never formed.
 
 This derivation makes a number of assumptions about the how the low dimensional points should best be arranged to minimise
 the stress. If you use an interative optimization algorithm such as SMACOF you may thus be able to find a better
@@ -167,6 +186,9 @@ see <a href="http://quest4rigor.com/tag/multidimensional-scaling/"> this website
 class ClassicalMultiDimensionalScaling : public AnalysisWithLandmarks {
 private:
   unsigned nlow;
+  bool iterative;
+  double tol;
+  unsigned maxiter;
   std::string ofilename;
   std::string efilename;
   std::unique_ptr<PointWiseMapping> myembedding;
@@ -183,17 +205,36 @@ void ClassicalMultiDimensionalScaling::registerKeywords( Keywords& keys ) {
   keys.add("compulsory","NLOW_DIM","number of low-dimensional coordinates required");
   keys.add("compulsory","OUTPUT_FILE","file on which to output the final embedding coordinates");
   keys.add("compulsory","EMBEDDING_OFILE","dont output","file on which to output the embedding in plumed input format");
+  keys.add("compulsory","EIGENSOLVER","FULL","the method used to find the projections.  FULL diagonalizes the full matrix of squared distances. "
+           "ITERATIVE finds only the NLOW_DIM eigenvectors that are required using subspace iteration.  If you use ITERATIVE with LOWMEM "
+           "the squared distances are recalculated at each iteration rather than stored.");
+  keys.add("compulsory","EIGENSOLVER_TOL","1e-10","the convergence tolerance of EIGENSOLVER=ITERATIVE.  The iteration stops when the residuals of the "
+           "eigenvectors are smaller than this fraction of the largest eigenvalue");
+  keys.add("compulsory","MAXITER","1000","the maximum number of iterations of EIGENSOLVER=ITERATIVE");
 }
 
 ClassicalMultiDimensionalScaling::ClassicalMultiDimensionalScaling( const ActionOptions& ao ):
   Action(ao),
   AnalysisWithLandmarks(ao),
+  iterative(false),
+  tol(1e-10),
+  maxiter(1000),
   myembedding(new PointWiseMapping( getMetricName(), false ))
 {
   setDataToAnalyze( dynamic_cast<MultiReferenceBase*>(myembedding.get()) );
 
   parse("NLOW_DIM",nlow);
   if( nlow<1 ) error("dimensionality of low dimensional space must be at least one");
+  std::string solver; parse("EIGENSOLVER",solver);
+  parse("EIGENSOLVER_TOL",tol); parse("MAXITER",maxiter);
+  if( tol<=0 ) error("EIGENSOLVER_TOL must be positive");
+  if( maxiter<1 ) error("MAXITER must be at least one");
+  if( solver=="ITERATIVE" ) {
+    iterative=true;
+    log.printf("  finding projections using subspace iteration with tolerance %g and at most %u iterations\n", tol, maxiter );
+    if( usingLowMem() ) log.printf("  squared distances will be recalculated at each iteration rather than stored\n");
+  } else if( solver!="FULL" ) error("no eigensolver " + solver + " use FULL or ITERATIVE");
+  else if( usingLowMem() ) warning("LOWMEM has no effect with EIGENSOLVER=FULL as the full matrix of squared distances must be stored");
   std::vector<std::string> propnames( nlow ); std::string num;
   for(unsigned i=0; i<propnames.size(); ++i) {
     Tools::convert(i+1,num); std::string lab=getLabel();
@@ -207,11 +248,24 @@ ClassicalMultiDimensionalScaling::ClassicalMultiDimensionalScaling( const Action
 }
 
 void ClassicalMultiDimensionalScaling::analyzeLandmarks() {
-  // Calculate all pairwise diatances
-  myembedding->calculateAllDistances( getPbc(), getArguments(), comm, myembedding->modifyDmat(), true );
-
-  // Run multidimensional scaling
-  ClassicalScaling::run( myembedding.get() );
+  if( iterative ) {
+    // Run multidimensional scaling either recalculating the distances blockwise or storing them all
+    unsigned niter; bool converged;
+    if( usingLowMem() ) {
+      niter=ClassicalScaling::runIterative( myembedding.get(), getPbc(), getArguments(), comm, tol, maxiter, converged );
+    } else {
+      myembedding->calculateAllDistances( getPbc(), getArguments(), comm, myembedding->modifyDmat(), true );
+      niter=ClassicalScaling::runIterative( myembedding.get(), comm, tol, maxiter, converged );
+    }
+    if( !converged ) warning("subspace iteration did not converge, consider increasing MAXITER");
+    else log.printf("  subspace iteration converged after %u iterations\n", niter );
+  } else {
+    // Calculate all pairwise diatances
+    myembedding->calculateAllDistances( getPbc(), getArguments(), comm, myembedding->modifyDmat(), true );
+
+    // Run multidimensional scaling
+    ClassicalScaling::run( myembedding.get() );
+  }
 
   // Output the embedding as long lists of data
 //  std::string gfname=saveResultsFromPreviousAnalyses( ofilename );
@@ -21,10 +21,129 @@
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 #include "ClassicalScaling.h"
 #include "reference/PointWiseMapping.h"
+#include "reference/ReferenceConfiguration.h"
+#include "tools/Communicator.h"
+#include "tools/Random.h"
+#include <algorithm>
+#include <cmath>
 
 namespace PLMD {
 namespace analysis {
 
+namespace {
+
+/// Multiply the matrix of squared distances by the vectors in the columns of Q and return the sums of
+/// the rows of the matrix of squared distances.  The squared distance between frames i and j is returned
+/// by dist2(i,j).  The pairs are divided between the nodes in the same way as in MultiReferenceBase::calculateAllDistances
+/// so each distance is evaluated only once.
+template <class F>
+void multiplyDistances( const F& dist2, Communicator& comm, const Matrix<double>& Q, Matrix<double>& DQ, std::vector<double>& rowsum ) {
+  unsigned n=Q.nrows(), p=Q.ncols(), k=0, size=comm.Get_size(), rank=comm.Get_rank();
+  DQ=0.0; rowsum.assign( n, 0.0 );
+  for(unsigned i=1; i<n; ++i) {
+    for(unsigned j=0; j<i; ++j) {
+      if( (k++)%size!=rank ) continue;
+      double d=dist2(i,j); rowsum[i]+=d; rowsum[j]+=d;
+      for(unsigned a=0; a<p; ++a) { DQ(i,a)+=d*Q(j,a); DQ(j,a)+=d*Q(i,a); }
+    }
+  }
+  comm.Sum( DQ ); comm.Sum( rowsum );
+}
+
+/// Orthonormalize the columns of Q using modified Gram-Schmidt.  Columns that are linearly
+/// dependent on the previous ones are replaced by random vectors.
+void orthonormalize( Matrix<double>& Q, Random& random ) {
+  unsigned n=Q.nrows(), p=Q.ncols();
+  for(unsigned a=0; a<p; ++a) {
+    for(unsigned attempt=0;; ++attempt) {
+      plumed_massert( attempt<10, "cannot construct an orthonormal basis for the subspace iteration" );
+      double norm0=0; for(unsigned i=0; i<n; ++i) norm0+=Q(i,a)*Q(i,a);
+      // Two passes are required to get orthogonality to machine precision
+      for(unsigned pass=0; pass<2; ++pass) {
+        for(unsigned b=0; b<a; ++b) {
+          double dot=0; for(unsigned i=0; i<n; ++i) dot+=Q(i,a)*Q(i,b);
+          for(unsigned i=0; i<n; ++i) Q(i,a)-=dot*Q(i,b);
+        }
+      }
+      double norm=0; for(unsigned i=0; i<n; ++i) norm+=Q(i,a)*Q(i,a);
+      if( norm>0 && norm>1e-16*norm0 ) {
+        norm=1.0/sqrt(norm); for(unsigned i=0; i<n; ++i) Q(i,a)*=norm;
+        break;
+      }
+      for(unsigned i=0; i<n; ++i) Q(i,a)=random.U01()-0.5;
+    }
+  }
+}
+
+/// Find the eigenvectors of the centered matrix of squared distances with the largest
+/// eigenvalues using subspace iteration with Rayleigh-Ritz projection.  A few more vectors
+/// than are required are iterated to accelerate convergence.
+template <class F>
+unsigned subspaceIteration( const F& dist2, PointWiseMapping* mymap, Communicator& comm, const double& tol, const unsigned& maxiter, bool& converged ) {
+  unsigned n=mymap->getNumberOfReferenceFrames(), nlow=mymap->getNumberOfProperties();
+  unsigned p=std::min( n, nlow+10 );
+
+  // The random vectors are the same on all nodes as the seed is fixed
+  Random random; random.setSeed(-1);
+  Matrix<double> Q(n,p), Y(n,p), V(n,p), BV(n,p), T(p,p), W;
+  std::vector<double> rowsum, theta;
+  for(unsigned i=0; i<n; ++i) for(unsigned a=0; a<p; ++a) Q(i,a)=random.U01()-0.5;
+  orthonormalize( Q, random );
+
+  unsigned iter=1;
+  for(;; ++iter) {
+    multiplyDistances( dist2, comm, Q, Y, rowsum );
+    // Apply the centering and the factor of -1/2 i.e. Y = -1/2 J D^2 J Q
+    double gmean=0; for(unsigned i=0; i<n; ++i) { rowsum[i]/=n; gmean+=rowsum[i]; }
+    gmean/=n;
+    for(unsigned a=0; a<p; ++a) {
+      double qsum=0, rq=0;
+      for(unsigned i=0; i<n; ++i) { qsum+=Q(i,a); rq+=rowsum[i]*Q(i,a); }
+      for(unsigned i=0; i<n; ++i) Y(i,a) = -0.5*( Y(i,a) - rowsum[i]*qsum - rq + gmean*qsum );
+    }
+
+    // Rayleigh-Ritz projection on the subspace
+    for(unsigned a=0; a<p; ++a) {
+      for(unsigned b=0; b<=a; ++b) {
+        double tab=0, tba=0;
+        for(unsigned i=0; i<n; ++i) { tab+=Q(i,a)*Y(i,b); tba+=Q(i,b)*Y(i,a); }
+        T(a,b)=T(b,a)=0.5*(tab+tba);
+      }
+    }
+    diagMat( T, theta, W );
+
+    // Construct the Ritz vectors in descending order of eigenvalue
+    V=0.0; BV=0.0;
+    for(unsigned c=0; c<p; ++c) {
+      for(unsigned i=0; i<n; ++i) {
+        for(unsigned a=0; a<p; ++a) { V(i,c)+=Q(i,a)*W(p-1-c,a); BV(i,c)+=Y(i,a)*W(p-1-c,a); }
+      }
+    }
+
+    // Check the residuals of the eigenvectors that are required
+    double scale=0; for(unsigned c=0; c<p; ++c) scale=std::max( scale, std::fabs(theta[c]) );
+    converged=true;
+    for(unsigned c=0; c<nlow && converged; ++c) {
+      double res=0;
+      for(unsigned i=0; i<n; ++i) { double tmp=BV(i,c)-theta[p-1-c]*V(i,c); res+=tmp*tmp; }
+      if( sqrt(res)>tol*scale ) converged=false;
+    }
+    if( converged || iter>=maxiter ) break;
+    Q=BV; orthonormalize( Q, random );
+  }
+
+  // Pass final projections to map object.  The phase is chosen as in diagMat so that
+  // results are the same as those from the full diagonalization
+  for(unsigned j=0; j<nlow; ++j) {
+    double phase=1.0;
+    for(unsigned i=0; i<n; ++i) if( V(i,j)*V(i,j)>1e-14 ) { if( V(i,j)<0 ) phase=-1.0; break; }
+    for(unsigned i=0; i<n; ++i) mymap->setProjectionCoordinate( i, j, phase*sqrt(theta[p-1-j])*V(i,j) );
+  }
+  return iter;
+}
+
+}
+
 void ClassicalScaling::run( PointWiseMapping* mymap ) {
   // Retrieve the distances from the dimensionality reduction object
   double half=(-0.5); Matrix<double> distances( half*mymap->modifyDmat() );
@@ -52,5 +171,18 @@ void ClassicalScaling::run( PointWiseMapping* mymap ) {
   }
 }
 
+unsigned ClassicalScaling::runIterative( PointWiseMapping* mymap, Communicator& comm, const double& tol, const unsigned& maxiter, bool& converged ) {
+  const Matrix<double>& dmat( mymap->modifyDmat() );
+  auto dist2=[&dmat]( const unsigned& i, const unsigned& j ) { return dmat(i,j); };
+  return subspaceIteration( dist2, mymap, comm, tol, maxiter, converged );
+}
+
+unsigned ClassicalScaling::runIterative( PointWiseMapping* mymap, const Pbc& pbc, const std::vector<Value*>& vals, Communicator& comm,
+                                         const double& tol, const unsigned& maxiter, bool& converged ) {
+  std::vector<ReferenceConfiguration*>& frames( mymap->getReferenceConfigurations() );
+  auto dist2=[&]( const unsigned& i, const unsigned& j ) { return distance( pbc, vals, frames[i], frames[j], true ); };
+  return subspaceIteration( dist2, mymap, comm, tol, maxiter, converged );
+}
+
 }
 }
@@ -26,13 +26,25 @@
 
 namespace PLMD {
 
+class Pbc;
+class Value;
+class Communicator;
 class PointWiseMapping;
 
 namespace analysis {
 
 class ClassicalScaling {
 public:
+/// Do classical scaling by diagonalizing the full matrix of squared distances
   static void run( PointWiseMapping* mymap );
+/// Do classical scaling by finding only the eigenvectors that are required using subspace iteration.
+/// This uses the matrix of squared distances stored in the mapping.  The iteration stops when the residuals
+/// of the eigenvectors are smaller than tol times the largest eigenvalue or after maxiter iterations.
+/// The number of iterations is returned and converged is set to true if the tolerance was reached.
+  static unsigned runIterative( PointWiseMapping* mymap, Communicator& comm, const double& tol, const unsigned& maxiter, bool& converged );
+/// As above but recompute the squared distances blockwise at each iteration rather than storing them
+  static unsigned runIterative( PointWiseMapping* mymap, const Pbc& pbc, const std::vector<Value*>& vals, Communicator& comm,
+                                const double& tol, const unsigned& maxiter, bool& converged );
 };
 
 }
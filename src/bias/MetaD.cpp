@@ -29,16 +29,24 @@
 #include "core/FlexibleBin.h"
 #include "tools/Matrix.h"
 #include "tools/Random.h"
+#include "tools/OpenMP.h"
 #include <string>
 #include <cstring>
 #include "tools/File.h"
+#include "tools/MappedRecords.h"
 #include <iostream>
 #include <limits>
 #include <ctime>
 #include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
 
 #define DP2CUTOFF 6.25
 
+// number of Gaussians (or grid points) evaluated together by MetaD::evaluateGaussianBlock
+static const unsigned gaussianBlockSize=256;
+
 using namespace std;
 
 
@@ -233,6 +241,29 @@ where all the walkers are located. WALKERS_RSTRIDE is the number of step between
 one update and the other. Since version 2.2.5, hills files are automatically
 flushed every WALKERS_RSTRIDE steps.
 
+When many walkers are run as separate processes on the same node, reading the hills
+files of all the other walkers can become expensive, since they have to be parsed
+every WALKERS_RSTRIDE steps. With the WALKERS_MMAP flag each walker also writes its
+hills in binary form to a file with the same name as its hills file and the suffix .bin.
+This file is mapped in memory by the other walkers, which get the new hills directly
+from there. If WALKERS_DIR is on a memory filesystem (e.g. /dev/shm) no disk access is involved.
+Notice that hills are visible to the other walkers as soon as they are deposited, rather than
+only after the hills file has been flushed, so results are not identical to those obtained without WALKERS_MMAP.
+The hills files are written as usual. When restarting, each walker reads its own hills
+file and appends to its own binary file (which is filled with the content of the hills
+file if it is missing), whereas the hills of the other walkers are read from their binary files.
+\plumedfile
+DISTANCE ATOMS=3,5 LABEL=d1
+METAD ...
+   ARG=d1 SIGMA=0.05 HEIGHT=0.3 PACE=500 LABEL=restraint
+   WALKERS_N=10
+   WALKERS_ID=3
+   WALKERS_DIR=/dev/shm/metad
+   WALKERS_RSTRIDE=100
+   WALKERS_MMAP
+... METAD
+\endplumedfile
+
 \par
 The c(t) reweighting factor can be calculated on the fly using the equations
 presented in \cite Tiwary_jp504920s as described above.
@@ -342,10 +373,23 @@ private:
     double height;
     bool   multivariate; // this is required to discriminate the one dimensional case
     vector<double> invsigma;
+    vector<double> invmatrix; // full inverse covariance, stored row by row (only for multivariate hills)
     Gaussian(const vector<double> & center,const vector<double> & sigma,double height, bool multivariate ):
       center(center),sigma(sigma),height(height),multivariate(multivariate),invsigma(sigma) {
       // to avoid troubles from zero element in flexible hills
       for(unsigned i=0; i<invsigma.size(); ++i) abs(invsigma[i])>1.e-20?invsigma[i]=1.0/invsigma[i]:0.;
+      if(multivariate) {
+        // recompose the full inverse matrix from its upper diagonal part
+        unsigned ncv=center.size();
+        unsigned k=0;
+        invmatrix.resize(ncv*ncv);
+        for(unsigned i=0; i<ncv; i++) {
+          for(unsigned j=i; j<ncv; j++) {
+            invmatrix[i*ncv+j]=invmatrix[j*ncv+i]=sigma[k];
+            k++;
+          }
+        }
+      }
     }
   };
   struct TemperingSpecs {
@@ -362,13 +406,18 @@ private:
   vector<double> sigma0_;
   vector<double> sigma0min_;
   vector<double> sigma0max_;
-  vector<Gaussian> hills_;
+  // hills in structure-of-arrays layout, only used when there is no grid
+  vector<double> hillsHeight_;
+  vector<vector<double> > hillsCenter_;
+  vector<vector<double> > hillsParam_;
+  vector<bool> hillsMultivariate_;
   OFile hillsOfile_;
   OFile gridfile_;
   std::unique_ptr<Grid> BiasGrid_;
   bool storeOldGrids_;
   int wgridstride_;
   bool grid_;
+  bool sparsegrid_;
   double height0_;
   double biasf_;
   static const size_t n_tempering_options_ = 1;
@@ -380,7 +429,6 @@ private:
   double kbt_;
   int stride_;
   bool welltemp_;
-  std::unique_ptr<double[]> dp_;
   int adaptive_;
   std::unique_ptr<FlexibleBin> flexbin;
   int mw_n_;
@@ -388,6 +436,9 @@ private:
   int mw_id_;
   int mw_rstride_;
   bool walkers_mpi;
+  bool walkers_mmap_;
+  vector<std::unique_ptr<MappedRecords>> mmfiles_;
+  vector<string> mmfilesnames_;
   unsigned mpi_nw_;
   unsigned mpi_mw_;
   bool acceleration;
@@ -409,20 +460,36 @@ private:
   unsigned rewf_ustride_;
   double work_;
   long int last_step_warn_grid;
+  // spatial index of the hills, used to only evaluate close hills when there is no grid
+  vector<double> hillsBucketWidth_;
+  vector<unsigned> hillsNBuckets_;
+  vector<double> hillsMaxCutoff_;
+  std::unordered_map<unsigned long long,vector<unsigned> > hillsBuckets_;
+  vector<unsigned> hillsUnbounded_;
 
   static void   registerTemperingKeywords(const std::string &name_stem, const std::string &name, Keywords &keys);
   void   readTemperingSpecs(TemperingSpecs &t_specs);
   void   logTemperingSpecs(const TemperingSpecs &t_specs);
-  void   readGaussians(IFile*);
+  void   readGaussians(IFile*,bool mirror=false);
   bool   readChunkOfGaussians(IFile *ifile, unsigned n);
   void   writeGaussian(const Gaussian&,OFile&);
+  unsigned getMappedHillSize();
+  void   writeMappedGaussian(const Gaussian&);
+  void   readMappedGaussians(unsigned);
   void   addGaussian(const Gaussian&);
+  void   depositGaussianBlock(const Gaussian&, const vector<Grid::index_t>&, unsigned first, unsigned stride, double* allbias, double* allder);
   double getHeight(const vector<double>&);
   void   temperHeight(double &height, const TemperingSpecs &t_specs, const double tempering_bias);
   double getBiasAndDerivatives(const vector<double>&,double* der=NULL);
-  double evaluateGaussian(const vector<double>&, const Gaussian&,double* der=NULL);
+  void   evaluateGaussianBlock(unsigned n, bool multivariate, const double* height, const double* param, double* dp, double* bias, double* der);
   double getGaussianNormalization( const Gaussian& );
   vector<unsigned> getGaussianSupport(const Gaussian&);
+  vector<double> getGaussianCutoff(const Gaussian&);
+  long int getHillsBucket(unsigned i, double x);
+  unsigned long long getHillsBucketKey(const vector<long int>&);
+  void   storeGaussian(const Gaussian&);
+  void   indexGaussian(const Gaussian&,unsigned);
+  void   getCloseGaussians(const vector<double>&, vector<unsigned>&);
   bool   scanOneHill(IFile *ifile,  vector<Value> &v, vector<double> &center, vector<double>  &sigma, double &height, bool &multivariate);
   void   computeReweightingFactor();
   double getTransitionBarrierBias();
@@ -487,6 +554,7 @@ void MetaD::registerKeywords(Keywords& keys) {
   keys.add("optional","SIGMA_MAX","the upper bounds for the sigmas (in CV units) when using adaptive hills. Negative number means no bounds ");
   keys.add("optional","SIGMA_MIN","the lower bounds for the sigmas (in CV units) when using adaptive hills. Negative number means no bounds ");
   keys.addFlag("WALKERS_MPI",false,"Switch on MPI version of multiple walkers - not compatible with WALKERS_* options other than WALKERS_DIR");
+  keys.addFlag("WALKERS_MMAP",false,"Share the hills with the other walkers through memory-mapped binary files rather than reading their hills files - only compatible with WALKERS_N, WALKERS_ID, WALKERS_DIR and WALKERS_RSTRIDE");
   keys.addFlag("ACCELERATION",false,"Set to TRUE if you want to compute the metadynamics acceleration factor.");
   keys.add("optional","ACCELERATION_RFILE","a data file from which the acceleration should be read at the initial step of the simulation");
   keys.addFlag("CALC_MAX_BIAS", false, "Set to TRUE if you want to compute the maximum of the metadynamics V(s, t)");
@@ -508,7 +576,7 @@ void MetaD::registerTemperingKeywords(const std::string &name_stem, const std::s
 MetaD::MetaD(const ActionOptions& ao):
   PLUMED_BIAS_INIT(ao),
 // Grid stuff initialization
-  wgridstride_(0), grid_(false),
+  wgridstride_(0), grid_(false), sparsegrid_(false),
 // Metadynamics basic parameters
   height0_(std::numeric_limits<double>::max()), biasf_(-1.0), dampfactor_(0.0),
   tt_specs_(false, "TT", "Transition Tempered", -1.0, 0.0, 1.0),
@@ -518,7 +586,7 @@ MetaD::MetaD(const ActionOptions& ao):
   adaptive_(FlexibleBin::none),
 // Multiple walkers initialization
   mw_n_(1), mw_dir_(""), mw_id_(0), mw_rstride_(1),
-  walkers_mpi(false), mpi_nw_(0), mpi_mw_(0),
+  walkers_mpi(false), walkers_mmap_(false), mpi_nw_(0), mpi_mw_(0),
   acceleration(false), acc(0.0), acc_restart_mean_(0.0),
   calc_max_bias_(false), max_bias_(0.0),
   calc_transition_bias_(false), transition_bias_(0.0),
@@ -705,6 +773,7 @@ MetaD::MetaD(const ActionOptions& ao):
   }
   bool sparsegrid=false;
   parseFlag("GRID_SPARSE",sparsegrid);
+  sparsegrid_=sparsegrid;
   bool nospline=false;
   parseFlag("GRID_NOSPLINE",nospline);
   bool spline=!nospline;
@@ -752,6 +821,13 @@ MetaD::MetaD(const ActionOptions& ao):
   // MPI version
   parseFlag("WALKERS_MPI",walkers_mpi);
 
+  // Memory-mapped version
+  parseFlag("WALKERS_MMAP",walkers_mmap_);
+#ifndef __PLUMED_HAS_MMAP
+  if(walkers_mmap_) error("WALKERS_MMAP requires plumed to be compiled with mmap");
+#endif
+  if(walkers_mmap_ && mw_n_<=1) error("WALKERS_MMAP should be used together with WALKERS_N and WALKERS_ID");
+
   // Inteval keyword
   vector<double> tmpI(2);
   parseVector("INTERVAL",tmpI);
@@ -857,6 +933,8 @@ MetaD::MetaD(const ActionOptions& ao):
     if(spline) {log.printf("  Grid uses spline interpolation\n");}
     if(sparsegrid) {log.printf("  Grid uses sparse grid\n");}
     if(wgridstride_>0) {log.printf("  Grid is written on file %s with stride %d\n",gridfilename_.c_str(),wgridstride_);}
+  } else {
+    log.printf("  Without a grid only hills closer than their cutoff are evaluated, using a spatial index\n");
   }
 
   if(mw_n_>1) {
@@ -865,6 +943,7 @@ MetaD::MetaD(const ActionOptions& ao):
     log.printf("  walker id %d\n",mw_id_);
     log.printf("  reading stride %d\n",mw_rstride_);
     if(mw_dir_!="")log.printf("  directory with hills files %s\n",mw_dir_.c_str());
+    if(walkers_mmap_) log.printf("  hills are shared through memory-mapped binary files\n");
   } else {
     if(walkers_mpi) {
       log.printf("  Multiple walkers active using MPI communnication\n");
@@ -959,9 +1038,6 @@ MetaD::MetaD(const ActionOptions& ao):
     }
   }
 
-  // for performance
-  dp_.reset( new double[getNumberOfArguments()] );
-
   // initializing and checking grid
   if(grid_) {
     // check for mesh and sigma size
@@ -1062,11 +1138,24 @@ MetaD::MetaD(const ActionOptions& ao):
     ifiles.emplace_back(ifile);
     ifilesnames.push_back(fname);
     ifile->link(*this);
+    // with memory-mapped walkers the own hills are also written to a binary file
+    // that is appended to when restarting. If it is empty it is filled with the
+    // hills read from the hills file, so that it always mirrors the hills file
+    bool mirror=false;
+    if(walkers_mmap_) {
+      mmfiles_.emplace_back(new MappedRecords);
+      mmfilesnames_.push_back(fname+".bin");
+      if(i==mw_id_ && comm.Get_rank()==0) {
+        mmfiles_[i]->openWrite(mmfilesnames_[i],getMappedHillSize(),getRestart());
+        mirror=(mmfiles_[i]->getNumberOfRecords()==0);
+      }
+    }
     if(ifile->FileExist(fname)) {
       ifile->open(fname);
-      if(getRestart()&&!restartedFromGrid) {
+      // with memory-mapped walkers the hills of the other walkers are read from their binary files
+      if(getRestart()&&!restartedFromGrid&&(!walkers_mmap_||i==mw_id_)) {
         log.printf("  Restarting from %s:",ifilesnames[i].c_str());
-        readGaussians(ifiles[i].get());
+        readGaussians(ifiles[i].get(),mirror);
       }
       ifiles[i]->reset(false);
       // close only the walker own hills file for later writing
@@ -1074,6 +1163,10 @@ MetaD::MetaD(const ActionOptions& ao):
     }
   }
 
+  if(walkers_mmap_ && getRestart() && !restartedFromGrid) {
+    for(int i=0; i<mw_n_; ++i) if(i!=mw_id_) readMappedGaussians(i);
+  }
+
   comm.Barrier();
   // this barrier is needed when using walkers_mpi
   // to be sure that all files have been read before
@@ -1212,7 +1305,7 @@ void MetaD::logTemperingSpecs(const TemperingSpecs &t_specs) {
   if (t_specs.alpha != 1.0) log.printf("  %s decay shape parameter alpha %f\n", t_specs.name.c_str(), t_specs.alpha);
 }
 
-void MetaD::readGaussians(IFile *ifile)
+void MetaD::readGaussians(IFile *ifile,bool mirror)
 {
   unsigned ncv=getNumberOfArguments();
   vector<double> center(ncv);
@@ -1229,7 +1322,9 @@ void MetaD::readGaussians(IFile *ifile)
     nhills++;
 // note that for gamma=1 we store directly -F
     if(welltemp_ && biasf_>1.0) {height*=(biasf_-1.0)/biasf_;}
-    addGaussian(Gaussian(center,sigma,height,multivariate));
+    Gaussian hill(center,sigma,height,multivariate);
+    addGaussian(hill);
+    if(mirror) writeMappedGaussian(hill);
   }
   log.printf("      %d Gaussians read\n",nhills);
 }
@@ -1311,35 +1406,95 @@ void MetaD::writeGaussian(const Gaussian& hill, OFile&file)
   file.printField();
 }
 
+unsigned MetaD::getMappedHillSize()
+{
+  // multivariate flag, height, center and the largest possible number of sigmas
+  unsigned ncv=getNumberOfArguments();
+  return 2+ncv+(ncv*(ncv+1))/2;
+}
+
+void MetaD::writeMappedGaussian(const Gaussian& hill)
+{
+  if(comm.Get_rank()!=0) return;
+  unsigned ncv=getNumberOfArguments();
+  vector<double> record(getMappedHillSize(),0.0);
+  record[0]=(hill.multivariate?1.0:0.0);
+  double height=hill.height;
+// the height is stored as in the hills file
+  if(welltemp_ && biasf_>1.0) height*=biasf_/(biasf_-1.0);
+  record[1]=height;
+  for(unsigned i=0; i<ncv; ++i) record[2+i]=hill.center[i];
+  for(unsigned i=0; i<hill.sigma.size(); ++i) record[2+ncv+i]=hill.sigma[i];
+  mmfiles_[mw_id_]->append(record);
+}
+
+void MetaD::readMappedGaussians(unsigned iw)
+{
+  unsigned ncv=getNumberOfArguments();
+  unsigned size=getMappedHillSize();
+  unsigned nhills=0;
+  vector<double> buffer;
+  if(comm.Get_rank()==0) {
+    MappedRecords* mmfile=mmfiles_[iw].get();
+    if(mmfile->isOpen() && mmfile->isReplaced()) {
+      log.printf("  WARNING: %s has been replaced, reading it again from the beginning\n",mmfilesnames_[iw].c_str());
+      mmfile->close();
+    }
+    if(mmfile->isOpen() || mmfile->openRead(mmfilesnames_[iw],size)) nhills=mmfile->readNew(buffer);
+  }
+  comm.Bcast(nhills,0);
+  if(nhills==0) return;
+  buffer.resize(nhills*size);
+  comm.Bcast(buffer,0);
+
+  log.printf("  Reading hills from %s:",mmfilesnames_[iw].c_str());
+  for(unsigned k=0; k<nhills; ++k) {
+    const double* record=&buffer[k*size];
+    bool multivariate=(record[0]>0.5);
+    double height=record[1];
+// note that for gamma=1 we store directly -F
+    if(welltemp_ && biasf_>1.0) height*=(biasf_-1.0)/biasf_;
+    vector<double> center(record+2,record+2+ncv);
+    vector<double> sigma(record+2+ncv,record+2+ncv+(multivariate?(ncv*(ncv+1))/2:ncv));
+    addGaussian(Gaussian(center,sigma,height,multivariate));
+  }
+  log.printf("      %u Gaussians read\n",nhills);
+}
+
 void MetaD::addGaussian(const Gaussian& hill)
 {
-  if(!grid_) hills_.push_back(hill);
+  if(!grid_) storeGaussian(hill);
   else {
     unsigned ncv=getNumberOfArguments();
     vector<unsigned> nneighb=getGaussianSupport(hill);
     vector<Grid::index_t> neighbors=BiasGrid_->getNeighbors(hill.center,nneighb);
-    vector<double> der(ncv);
-    vector<double> xx(ncv);
-    if(comm.Get_size()==1) {
-      for(unsigned i=0; i<neighbors.size(); ++i) {
-        Grid::index_t ineigh=neighbors[i];
-        for(unsigned j=0; j<ncv; ++j) der[j]=0.0;
-        BiasGrid_->getPoint(ineigh,xx);
-        double bias=evaluateGaussian(xx,hill,&der[0]);
-        BiasGrid_->addValueAndDerivatives(ineigh,bias,der);
-      }
+    const unsigned nblocks=(neighbors.size()+gaussianBlockSize-1)/gaussianBlockSize;
+    unsigned stride=comm.Get_size();
+    unsigned rank=comm.Get_rank();
+    // With threads each rank deposits the whole hill and every thread writes its
+    // own grid points. This is not possible on sparse grids, nor when a grid point
+    // appears twice in the neighbors because the hill is wider than a periodic grid
+    unsigned nt=OpenMP::getNumThreads();
+    if(nt>nblocks) nt=nblocks;
+    if(nt==0) nt=1;
+    if(sparsegrid_) nt=1;
+    if(nt>1) {
+      vector<unsigned> nbin=BiasGrid_->getNbin();
+      vector<bool> isperiodic=BiasGrid_->getIsPeriodic();
+      for(unsigned j=0; j<ncv; ++j) if(isperiodic[j] && 2*nneighb[j]+1>nbin[j]) nt=1;
+    }
+    if(nt>1 || stride==1) {
+      #pragma omp parallel for num_threads(nt)
+      for(unsigned b=0; b<nblocks; ++b) depositGaussianBlock(hill,neighbors,b*gaussianBlockSize,1,NULL,NULL);
     } else {
-      unsigned stride=comm.Get_size();
-      unsigned rank=comm.Get_rank();
       vector<double> allder(ncv*neighbors.size(),0.0);
       vector<double> allbias(neighbors.size(),0.0);
-      for(unsigned i=rank; i<neighbors.size(); i+=stride) {
-        Grid::index_t ineigh=neighbors[i];
-        BiasGrid_->getPoint(ineigh,xx);
-        allbias[i]=evaluateGaussian(xx,hill,&allder[ncv*i]);
+      for(unsigned i=rank; i<neighbors.size(); i+=gaussianBlockSize*stride) {
+        depositGaussianBlock(hill,neighbors,i,stride,&allbias[0],&allder[0]);
       }
       comm.Sum(allbias);
       comm.Sum(allder);
+      vector<double> der(ncv);
       for(unsigned i=0; i<neighbors.size(); ++i) {
         Grid::index_t ineigh=neighbors[i];
         for(unsigned j=0; j<ncv; ++j) {der[j]=allder[ncv*i+j];}
@@ -1349,6 +1504,45 @@ void MetaD::addGaussian(const Gaussian& hill)
   }
 }
 
+void MetaD::depositGaussianBlock(const Gaussian& hill, const vector<Grid::index_t>& neighbors, unsigned first, unsigned stride, double* allbias, double* allder)
+{
+  // evaluate the hill on up to gaussianBlockSize points, starting from neighbors[first]
+  // with the given stride. Values are added to the grid, or stored in allbias/allder
+  unsigned ncv=getNumberOfArguments();
+  const unsigned nparam=(hill.multivariate ? ncv*ncv : ncv);
+  const vector<double>& hillparam(hill.multivariate ? hill.invmatrix : hill.invsigma);
+  vector<double> height(gaussianBlockSize,hill.height);
+  vector<double> param(nparam*gaussianBlockSize);
+  for(unsigned p=0; p<nparam; ++p) for(unsigned k=0; k<gaussianBlockSize; ++k) param[p*gaussianBlockSize+k]=hillparam[p];
+  vector<double> dp(ncv*gaussianBlockSize);
+  vector<double> bias(gaussianBlockSize);
+  vector<double> blockder(ncv*gaussianBlockSize);
+  vector<unsigned> ipoints(gaussianBlockSize);
+  vector<double> xx(ncv);
+  vector<double> der(ncv);
+
+  unsigned n=0;
+  for(unsigned i=first; n<gaussianBlockSize && i<neighbors.size(); ++n, i+=stride) {
+    ipoints[n]=i;
+    BiasGrid_->getPoint(neighbors[i],xx);
+    if(doInt_) xx[0]=std::min(std::max(xx[0],lowI_),uppI_);
+    for(unsigned j=0; j<ncv; ++j) dp[j*gaussianBlockSize+n]=difference(j,hill.center[j],xx[j]);
+  }
+  evaluateGaussianBlock(n,hill.multivariate,&height[0],&param[0],&dp[0],&bias[0],&blockder[0]);
+  for(unsigned k=0; k<n; ++k) {
+    for(unsigned j=0; j<ncv; ++j) der[j]=blockder[j*gaussianBlockSize+k];
+    if(doInt_) {
+      BiasGrid_->getPoint(neighbors[ipoints[k]],xx);
+      if(xx[0]<lowI_ || xx[0]>uppI_) for(unsigned j=0; j<ncv; ++j) der[j]=0;
+    }
+    if(!allbias) BiasGrid_->addValueAndDerivatives(neighbors[ipoints[k]],bias[k],der);
+    else {
+      allbias[ipoints[k]]=bias[k];
+      for(unsigned j=0; j<ncv; ++j) allder[ncv*ipoints[k]+j]=der[j];
+    }
+  }
+}
+
 vector<unsigned> MetaD::getGaussianSupport(const Gaussian& hill)
 {
   vector<unsigned> nneigh;
@@ -1403,22 +1597,212 @@ vector<unsigned> MetaD::getGaussianSupport(const Gaussian& hill)
   return nneigh;
 }
 
+vector<double> MetaD::getGaussianCutoff(const Gaussian& hill)
+{
+  // half width along each CV of the region where exp(-dp2) is not truncated
+  unsigned ncv=getNumberOfArguments();
+  vector<double> cutoff(ncv);
+  if(hill.multivariate) {
+    unsigned k=0;
+    Matrix<double> mymatrix(ncv,ncv);
+    for(unsigned i=0; i<ncv; i++) {
+      for(unsigned j=i; j<ncv; j++) {
+        // recompose the full inverse matrix
+        mymatrix(i,j)=mymatrix(j,i)=hill.sigma[k];
+        k++;
+      }
+    }
+    // the extent of the ellipsoid along each CV is given by the diagonal of the covariance
+    Matrix<double> myinv(ncv,ncv);
+    Invert(mymatrix,myinv);
+    for(unsigned i=0; i<ncv; i++) cutoff[i]=sqrt(2.0*DP2CUTOFF*myinv(i,i));
+  } else {
+    for(unsigned i=0; i<ncv; ++i) {
+      // a zero sigma means that the hill is not truncated along this CV, see evaluateGaussianBlock
+      cutoff[i]=(hill.invsigma[i]!=0.0 ? sqrt(2.0*DP2CUTOFF)*hill.sigma[i] : std::numeric_limits<double>::infinity());
+    }
+  }
+  return cutoff;
+}
+
+long int MetaD::getHillsBucket(unsigned i, double x)
+{
+  if(hillsNBuckets_[i]>0) {
+    double min,max;
+    getPntrToArgument(i)->getDomain(min,max);
+    double t=(x-min)/(max-min);
+    t-=floor(t);
+    long int b=static_cast<long int>(floor(t*hillsNBuckets_[i]));
+    return (b<static_cast<long int>(hillsNBuckets_[i]) ? b : hillsNBuckets_[i]-1);
+  }
+  return static_cast<long int>(floor(x/hillsBucketWidth_[i]));
+}
+
+unsigned long long MetaD::getHillsBucketKey(const vector<long int>& b)
+{
+  // bucket coordinates are packed in a single integer. Coordinates that do not fit
+  // are folded, so that different buckets can share the same key: this only results
+  // in evaluating more hills than needed
+  const unsigned nbits=64/b.size();
+  const unsigned long long mask=(nbits>=64 ? ~0ULL : (1ULL<<nbits)-1);
+  unsigned long long key=0;
+  for(unsigned i=0; i<b.size(); ++i) key|=(static_cast<unsigned long long>(b[i])&mask)<<(nbits*i);
+  return key;
+}
+
+void MetaD::storeGaussian(const Gaussian& hill)
+{
+  unsigned ncv=getNumberOfArguments();
+  unsigned ihill=hillsHeight_.size();
+  if(hillsCenter_.size()==0) {
+    hillsCenter_.resize(ncv);
+    hillsParam_.resize(ncv);
+  }
+  // parameters are the inverse sigmas, or the full inverse covariance for multivariate hills
+  if(hill.multivariate && hillsParam_.size()<ncv*ncv) {
+    hillsParam_.resize(ncv*ncv,vector<double>(ihill,0.0));
+  }
+  hillsHeight_.push_back(hill.height);
+  hillsMultivariate_.push_back(hill.multivariate);
+  for(unsigned i=0; i<ncv; ++i) hillsCenter_[i].push_back(hill.center[i]);
+  for(unsigned p=0; p<hillsParam_.size(); ++p) {
+    if(hill.multivariate) hillsParam_[p].push_back(hill.invmatrix[p]);
+    else hillsParam_[p].push_back(p<ncv ? hill.invsigma[p] : 0.0);
+  }
+  indexGaussian(hill,ihill);
+}
+
+void MetaD::indexGaussian(const Gaussian& hill, unsigned ihill)
+{
+  unsigned ncv=getNumberOfArguments();
+  vector<double> cutoff=getGaussianCutoff(hill);
+  for(unsigned i=0; i<ncv; ++i) {
+    if(!std::isfinite(cutoff[i])) {
+      // this hill should be evaluated everywhere
+      hillsUnbounded_.push_back(ihill);
+      return;
+    }
+  }
+
+  // the first hill sets the size of the buckets
+  if(hillsBucketWidth_.size()==0) {
+    hillsBucketWidth_.resize(ncv);
+    hillsNBuckets_.assign(ncv,0);
+    hillsMaxCutoff_.assign(ncv,0.0);
+    for(unsigned i=0; i<ncv; ++i) {
+      double width=(cutoff[i]>0.0 ? cutoff[i] : 1.0);
+      if(getPntrToArgument(i)->isPeriodic()) {
+        double min,max;
+        getPntrToArgument(i)->getDomain(min,max);
+        hillsNBuckets_[i]=static_cast<unsigned>(floor((max-min)/width));
+        if(hillsNBuckets_[i]==0) hillsNBuckets_[i]=1;
+        width=(max-min)/hillsNBuckets_[i];
+      }
+      hillsBucketWidth_[i]=width;
+    }
+  }
+
+  vector<long int> b(ncv);
+  for(unsigned i=0; i<ncv; ++i) {
+    if(cutoff[i]>hillsMaxCutoff_[i]) hillsMaxCutoff_[i]=cutoff[i];
+    b[i]=getHillsBucket(i,hill.center[i]);
+  }
+  hillsBuckets_[getHillsBucketKey(b)].push_back(ihill);
+}
+
+void MetaD::getCloseGaussians(const vector<double>& cv, vector<unsigned>& close)
+{
+  close=hillsUnbounded_;
+  if(hillsBuckets_.size()>0) {
+    unsigned ncv=getNumberOfArguments();
+    // range of buckets that can contain hills overlapping with cv
+    vector<long int> lower(ncv), upper(ncv);
+    for(unsigned i=0; i<ncv; ++i) {
+      double x=cv[i];
+      if(doInt_) x=std::min(std::max(x,lowI_),uppI_);
+      // small margin to be safe against rounding
+      double cutoff=hillsMaxCutoff_[i]*(1.0+1.e-8);
+      if(hillsNBuckets_[i]>0) {
+        double min,max;
+        getPntrToArgument(i)->getDomain(min,max);
+        lower[i]=static_cast<long int>(floor((x-cutoff-min)/hillsBucketWidth_[i]));
+        upper[i]=static_cast<long int>(floor((x+cutoff-min)/hillsBucketWidth_[i]));
+        if(upper[i]-lower[i]+1>=static_cast<long int>(hillsNBuckets_[i])) {
+          lower[i]=0; upper[i]=hillsNBuckets_[i]-1;
+        }
+      } else {
+        lower[i]=getHillsBucket(i,x-cutoff);
+        upper[i]=getHillsBucket(i,x+cutoff);
+      }
+    }
+    // loop over all the buckets in the range
+    vector<unsigned long long> keys;
+    vector<long int> b(lower);
+    while(true) {
+      vector<long int> bb(b);
+      for(unsigned i=0; i<ncv; ++i) if(hillsNBuckets_[i]>0) {
+          long int n=hillsNBuckets_[i];
+          bb[i]=((bb[i]%n)+n)%n;
+        }
+      keys.push_back(getHillsBucketKey(bb));
+      unsigned i=0;
+      for(; i<ncv; ++i) {
+        if(b[i]<upper[i]) {b[i]++; break;}
+        b[i]=lower[i];
+      }
+      if(i==ncv) break;
+    }
+    // buckets sharing the same key should be visited once
+    std::sort(keys.begin(),keys.end());
+    keys.erase(std::unique(keys.begin(),keys.end()),keys.end());
+    for(unsigned k=0; k<keys.size(); ++k) {
+      auto it=hillsBuckets_.find(keys[k]);
+      if(it!=hillsBuckets_.end()) close.insert(close.end(),it->second.begin(),it->second.end());
+    }
+  }
+  // hills are evaluated in the order in which they were added
+  std::sort(close.begin(),close.end());
+}
+
 double MetaD::getBiasAndDerivatives(const vector<double>& cv, double* der)
 {
   double bias=0.0;
   if(!grid_) {
-    if(hills_.size()>10000 && (getStep()-last_step_warn_grid)>10000) {
+    if(hillsHeight_.size()>10000 && (getStep()-last_step_warn_grid)>10000) {
       std::string msg;
-      Tools::convert(hills_.size(),msg);
+      Tools::convert(hillsHeight_.size(),msg);
       msg="You have accumulated "+msg+" hills, you should enable GRIDs to avoid serious performance hits";
       warning(msg);
       last_step_warn_grid=getStep();
     }
+    unsigned ncv=getNumberOfArguments();
+    vector<double> x(cv);
+    if(doInt_) x[0]=std::min(std::max(x[0],lowI_),uppI_);
+    vector<unsigned> close;
+    getCloseGaussians(x,close);
     unsigned stride=comm.Get_size();
     unsigned rank=comm.Get_rank();
-    for(unsigned i=rank; i<hills_.size(); i+=stride) {
-      bias+=evaluateGaussian(cv,hills_[i],der);
+    // the hills of this rank are evaluated in blocks of hills of the same kind
+    vector<double> height(gaussianBlockSize);
+    vector<double> param(hillsParam_.size()*gaussianBlockSize);
+    vector<double> dp(ncv*gaussianBlockSize);
+    vector<double> hbias(gaussianBlockSize);
+    vector<double> hder(ncv*gaussianBlockSize);
+    for(unsigned i=rank; i<close.size();) {
+      const bool multivariate=hillsMultivariate_[close[i]];
+      const unsigned nparam=(multivariate ? ncv*ncv : ncv);
+      unsigned n=0;
+      for(; n<gaussianBlockSize && i<close.size() && hillsMultivariate_[close[i]]==multivariate; ++n, i+=stride) {
+        unsigned ihill=close[i];
+        height[n]=hillsHeight_[ihill];
+        for(unsigned p=0; p<nparam; ++p) param[p*gaussianBlockSize+n]=hillsParam_[p][ihill];
+        for(unsigned j=0; j<ncv; ++j) dp[j*gaussianBlockSize+n]=difference(j,hillsCenter_[j][ihill],x[j]);
+      }
+      evaluateGaussianBlock(n,multivariate,&height[0],&param[0],&dp[0],&hbias[0],(der ? &hder[0] : NULL));
+      for(unsigned k=0; k<n; ++k) bias+=hbias[k];
+      if(der) for(unsigned j=0; j<ncv; ++j) for(unsigned k=0; k<n; ++k) der[j]+=hder[j*gaussianBlockSize+k];
     }
+    if(der && doInt_ && (cv[0]<lowI_ || cv[0]>uppI_)) for(unsigned j=0; j<ncv; ++j) der[j]=0;
     comm.Sum(bias);
     if(der) comm.Sum(der,getNumberOfArguments());
   } else {
@@ -1458,78 +1842,66 @@ double MetaD::getGaussianNormalization( const Gaussian& hill )
   return norm*pow(2*pi,static_cast<double>(ncv)/2.0);
 }
 
-double MetaD::evaluateGaussian(const vector<double>& cv, const Gaussian& hill, double* der)
+void MetaD::evaluateGaussianBlock(unsigned n, bool multivariate, const double* height, const double* param, double* dp, double* bias, double* der)
 {
-  double dp2=0.0;
-  double bias=0.0;
-  // I use a pointer here because cv is const (and should be const)
-  // but when using doInt it is easier to locally replace cv[0] with
-  // the upper/lower limit in case it is out of range
-  const double *pcv=NULL; // pointer to cv
-  double tmpcv[1]; // tmp array with cv (to be used with doInt_)
-  if(cv.size()>0) pcv=&cv[0];
-  if(doInt_) {
-    plumed_assert(cv.size()==1);
-    tmpcv[0]=cv[0];
-    if(cv[0]<lowI_) tmpcv[0]=lowI_;
-    if(cv[0]>uppI_) tmpcv[0]=uppI_;
-    pcv=&(tmpcv[0]);
-  }
-  if(hill.multivariate) {
-    unsigned k=0;
-    unsigned ncv=cv.size();
-    // recompose the full sigma from the upper diag cholesky
-    Matrix<double> mymatrix(ncv,ncv);
-    for(unsigned i=0; i<ncv; i++) {
-      for(unsigned j=i; j<ncv; j++) {
-        mymatrix(i,j)=mymatrix(j,i)=hill.sigma[k]; // recompose the full inverse matrix
-        k++;
+  // All the arrays are stored by CV (or by matrix element) with leading dimension
+  // ld=gaussianBlockSize, so that each loop over the n Gaussians runs on contiguous
+  // memory and can be vectorized.
+  // dp[i*ld+k] is the difference between point and center along CV i for Gaussian k,
+  // param[p*ld+k] is the inverse sigma (or the inverse covariance element p) of Gaussian k.
+  // On output dp is overwritten, bias[k] and der[i*ld+k] contain value and derivatives.
+  const unsigned ncv=getNumberOfArguments();
+  const unsigned ld=gaussianBlockSize;
+  // bias is used to accumulate dp2 before computing the exponential
+  for(unsigned k=0; k<n; ++k) bias[k]=0.0;
+  if(multivariate) {
+    for(unsigned i=0; i<ncv; ++i) {
+      const double* dp_i=dp+i*ld;
+      const double* m_ii=param+(i*ncv+i)*ld;
+      for(unsigned k=0; k<n; ++k) bias[k]+=dp_i[k]*dp_i[k]*m_ii[k]*0.5;
+      for(unsigned j=i+1; j<ncv; ++j) {
+        const double* dp_j=dp+j*ld;
+        const double* m_ij=param+(i*ncv+j)*ld;
+        for(unsigned k=0; k<n; ++k) bias[k]+=dp_i[k]*dp_j[k]*m_ij[k];
       }
     }
-    for(unsigned i=0; i<cv.size(); ++i) {
-      double dp_i=difference(i,hill.center[i],pcv[i]);
-      dp_[i]=dp_i;
-      for(unsigned j=i; j<cv.size(); ++j) {
-        if(i==j) {
-          dp2+=dp_i*dp_i*mymatrix(i,j)*0.5;
-        } else {
-          double dp_j=difference(j,hill.center[j],pcv[j]);
-          dp2+=dp_i*dp_j*mymatrix(i,j);
+    #pragma omp simd
+    for(unsigned k=0; k<n; ++k) bias[k]=(bias[k]<DP2CUTOFF ? height[k]*exp(-bias[k]) : 0.0);
+    if(der) {
+      for(unsigned i=0; i<ncv; ++i) {
+        double* der_i=der+i*ld;
+        for(unsigned k=0; k<n; ++k) der_i[k]=0.0;
+        for(unsigned j=0; j<ncv; ++j) {
+          const double* dp_j=dp+j*ld;
+          const double* m_ij=param+(i*ncv+j)*ld;
+          for(unsigned k=0; k<n; ++k) der_i[k]+=dp_j[k]*m_ij[k]*bias[k];
         }
+        for(unsigned k=0; k<n; ++k) der_i[k]=-der_i[k];
       }
     }
-    if(dp2<DP2CUTOFF) {
-      bias=hill.height*exp(-dp2);
-      if(der) {
-        for(unsigned i=0; i<cv.size(); ++i) {
-          double tmp=0.0;
-          for(unsigned j=0; j<cv.size(); ++j) {
-            tmp += dp_[j]*mymatrix(i,j)*bias;
-          }
-          der[i]-=tmp;
-        }
+  } else {
+    for(unsigned i=0; i<ncv; ++i) {
+      double* dp_i=dp+i*ld;
+      const double* invsigma_i=param+i*ld;
+      for(unsigned k=0; k<n; ++k) {
+        dp_i[k]*=invsigma_i[k];
+        bias[k]+=dp_i[k]*dp_i[k];
       }
     }
-  } else {
-    for(unsigned i=0; i<cv.size(); ++i) {
-      double dp=difference(i,hill.center[i],pcv[i])*hill.invsigma[i];
-      dp2+=dp*dp;
-      dp_[i]=dp;
-    }
-    dp2*=0.5;
-    if(dp2<DP2CUTOFF) {
-      bias=hill.height*exp(-dp2);
-      if(der) {
-        for(unsigned i=0; i<cv.size(); ++i) {der[i]+=-bias*dp_[i]*hill.invsigma[i];}
+    #pragma omp simd
+    for(unsigned k=0; k<n; ++k) {
+      double dp2=0.5*bias[k];
+      bias[k]=(dp2<DP2CUTOFF ? height[k]*exp(-dp2) : 0.0);
+    }
+    if(der) {
+      for(unsigned i=0; i<ncv; ++i) {
+        const double* dp_i=dp+i*ld;
+        const double* invsigma_i=param+i*ld;
+        double* der_i=der+i*ld;
+        for(unsigned k=0; k<n; ++k) der_i[k]=-bias[k]*dp_i[k]*invsigma_i[k];
       }
     }
   }
-
-  if(doInt_ && der) {
-    if(cv[0]<lowI_ || cv[0]>uppI_) for(unsigned i=0; i<cv.size(); ++i) der[i]=0;
-  }
-
-  return bias;
 }
 
 double MetaD::getHeight(const vector<double>& cv)
@@ -1675,6 +2047,7 @@ void MetaD::update() {
       addGaussian(newhill);
       // print on HILLS file
       writeGaussian(newhill,hillsOfile_);
+      if(walkers_mmap_) writeMappedGaussian(newhill);
     }
   }
 
@@ -1717,6 +2090,10 @@ void MetaD::update() {
     for(int i=0; i<mw_n_; ++i) {
       // don't read your own Gaussians
       if(i==mw_id_) continue;
+      if(walkers_mmap_) {
+        readMappedGaussians(i);
+        continue;
+      }
       // if the file is not open yet
       if(!(ifiles[i]->isOpen())) {
         // check if it exists now and open it!
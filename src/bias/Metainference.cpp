@@ -466,7 +466,8 @@ double Metainference::getEnergyForceSPE()
 
   const double smean2 = sigma_mean_*sigma_mean_;
   const double s = sqrt( sigma_[0]*sigma_[0] + smean2 );
-  vector<double> f(narg,0);
+  // forces and energy are packed together so that they are reduced at once
+  vector<double> f(narg+1,0);
 
   if(comm.Get_rank()==0) {
     for(unsigned i=0; i<narg; ++i) {
@@ -480,14 +481,16 @@ double Metainference::getEnergyForceSPE()
       f[i] = -scale_*dev*(dit/smean2 + 1./a2);
     }
     // collect contribution to forces and energy from other replicas
-    multi_sim_comm.Sum(&f[0],narg);
-    multi_sim_comm.Sum(&ene,1);
+    f[narg]=ene;
+    multi_sim_comm.Sum(&f[0],narg+1);
+    ene=f[narg];
     // add normalizations and priors of local replica
     ene += std::log(s) - static_cast<double>(ndata_)*std::log(sqrt2_div_pi*s);
   }
   // intra-replica summation
-  comm.Sum(&f[0],narg);
-  comm.Sum(&ene,1);
+  f[narg]=ene;
+  comm.Sum(&f[0],narg+1);
+  ene=f[narg];
 
   for(unsigned i=0; i<narg; ++i) setOutputForce(i, kbt_ * f[i]);
   return ene;
@@ -38,6 +38,9 @@
 
 #define DP2CUTOFF 6.25
 
+// maximum number of grid points whose values are reduced together by PBMetaD::addGaussians
+static const unsigned maxPackedPoints=1048576;
+
 using namespace std;
 
 
@@ -265,7 +268,8 @@ private:
   bool   readChunkOfGaussians(unsigned iarg, IFile *ifile, unsigned n);
   void   writeGaussian(unsigned iarg, const Gaussian&, OFile*);
   void   addGaussian(unsigned iarg, const Gaussian&);
-  double getBiasAndDerivatives(unsigned iarg, const vector<double>&, double* der=NULL);
+  void   addGaussians(const vector<unsigned>& iarg, const vector<Gaussian>&);
+  void   getBiasAndDerivatives(const vector<double>& cv, vector<double>& bias, vector<double>* der=NULL);
   double evaluateGaussian(unsigned iarg, const vector<double>&, const Gaussian&,double* der=NULL);
   vector<unsigned> getGaussianSupport(unsigned iarg, const Gaussian&);
   bool   scanOneHill(unsigned iarg, IFile *ifile,  vector<Value> &v, vector<double> &center, vector<double>  &sigma, double &height, bool &multivariate);
@@ -779,12 +783,15 @@ void PBMetaD::readGaussians(unsigned iarg, IFile *ifile)
   std::vector<Value> tmpvalues;
   tmpvalues.push_back( Value( this, getPntrToArgument(iarg)->getName(), false ) );
 
+  vector<Gaussian> hills;
   while(scanOneHill(iarg,ifile,tmpvalues,center,sigma,height,multivariate)) {
     ;
     nhills++;
     if(welltemp_) {height*=(biasf_-1.0)/biasf_;}
-    addGaussian(iarg, Gaussian(center,sigma,height,multivariate));
+    hills.push_back(Gaussian(center,sigma,height,multivariate));
   }
+  // all the hills read are added together
+  addGaussians(vector<unsigned>(hills.size(),iarg), hills);
   log.printf("      %d Gaussians read\n",nhills);
 }
 
@@ -836,38 +843,67 @@ void PBMetaD::writeGaussian(unsigned iarg, const Gaussian& hill, OFile *ofile)
 
 void PBMetaD::addGaussian(unsigned iarg, const Gaussian& hill)
 {
-  if(!grid_) {hills_[iarg].push_back(hill);}
-  else {
-    vector<unsigned> nneighb=getGaussianSupport(iarg, hill);
-    vector<Grid::index_t> neighbors=BiasGrids_[iarg]->getNeighbors(hill.center,nneighb);
-    vector<double> der(1);
-    vector<double> xx(1);
-    if(comm.Get_size()==1) {
+  addGaussians(vector<unsigned>(1,iarg), vector<Gaussian>(1,hill));
+}
+
+void PBMetaD::addGaussians(const vector<unsigned>& iarg, const vector<Gaussian>& hills)
+{
+  plumed_dbg_assert(iarg.size()==hills.size());
+  if(!grid_) {
+    for(unsigned k=0; k<hills.size(); ++k) hills_[iarg[k]].push_back(hills[k]);
+    return;
+  }
+  vector<double> der(1);
+  vector<double> xx(1);
+  if(comm.Get_size()==1) {
+    for(unsigned k=0; k<hills.size(); ++k) {
+      vector<Grid::index_t> neighbors=BiasGrids_[iarg[k]]->getNeighbors(hills[k].center,getGaussianSupport(iarg[k],hills[k]));
       for(unsigned i=0; i<neighbors.size(); ++i) {
         Grid::index_t ineigh=neighbors[i];
         der[0]=0.0;
-        BiasGrids_[iarg]->getPoint(ineigh,xx);
-        double bias=evaluateGaussian(iarg,xx,hill,&der[0]);
-        BiasGrids_[iarg]->addValueAndDerivatives(ineigh,bias,der);
+        BiasGrids_[iarg[k]]->getPoint(ineigh,xx);
+        double bias=evaluateGaussian(iarg[k],xx,hills[k],&der[0]);
+        BiasGrids_[iarg[k]]->addValueAndDerivatives(ineigh,bias,der);
       }
-    } else {
-      unsigned stride=comm.Get_size();
-      unsigned rank=comm.Get_rank();
-      vector<double> allder(neighbors.size(),0.0);
-      vector<double> allbias(neighbors.size(),0.0);
-      for(unsigned i=rank; i<neighbors.size(); i+=stride) {
-        Grid::index_t ineigh=neighbors[i];
-        BiasGrids_[iarg]->getPoint(ineigh,xx);
-        allbias[i]=evaluateGaussian(iarg,xx,hill,&allder[i]);
+    }
+    return;
+  }
+  // the grid points of each hill are divided among the processes and the values and
+  // derivatives of all the hills are packed in a single buffer, so that a single
+  // reduction is needed for all the hills (unless the buffer grows too large)
+  unsigned stride=comm.Get_size();
+  unsigned rank=comm.Get_rank();
+  unsigned k0=0;
+  while(k0<hills.size()) {
+    vector<vector<Grid::index_t> > neighbors;
+    unsigned k1=k0, npoints=0;
+    while(k1<hills.size() && (k1==k0 || npoints<maxPackedPoints)) {
+      neighbors.push_back(BiasGrids_[iarg[k1]]->getNeighbors(hills[k1].center,getGaussianSupport(iarg[k1],hills[k1])));
+      npoints+=neighbors.back().size();
+      k1++;
+    }
+    // values are stored first, then derivatives
+    vector<double> buffer(2*npoints,0.0);
+    unsigned offset=0;
+    for(unsigned k=k0; k<k1; ++k) {
+      const vector<Grid::index_t>& nn(neighbors[k-k0]);
+      for(unsigned i=rank; i<nn.size(); i+=stride) {
+        BiasGrids_[iarg[k]]->getPoint(nn[i],xx);
+        buffer[offset+i]=evaluateGaussian(iarg[k],xx,hills[k],&buffer[npoints+offset+i]);
       }
-      comm.Sum(allbias);
-      comm.Sum(allder);
-      for(unsigned i=0; i<neighbors.size(); ++i) {
-        Grid::index_t ineigh=neighbors[i];
-        der[0]=allder[i];
-        BiasGrids_[iarg]->addValueAndDerivatives(ineigh,allbias[i],der);
+      offset+=nn.size();
+    }
+    comm.Sum(buffer);
+    offset=0;
+    for(unsigned k=k0; k<k1; ++k) {
+      const vector<Grid::index_t>& nn(neighbors[k-k0]);
+      for(unsigned i=0; i<nn.size(); ++i) {
+        der[0]=buffer[npoints+offset+i];
+        BiasGrids_[iarg[k]]->addValueAndDerivatives(nn[i],buffer[offset+i],der);
       }
+      offset+=nn.size();
     }
+    k0=k1;
   }
 }
 
@@ -897,28 +933,42 @@ vector<unsigned> PBMetaD::getGaussianSupport(unsigned iarg, const Gaussian& hill
   return nneigh;
 }
 
-double PBMetaD::getBiasAndDerivatives(unsigned iarg, const vector<double>& cv, double* der)
+void PBMetaD::getBiasAndDerivatives(const vector<double>& cv, vector<double>& bias, vector<double>* der)
 {
-  double bias=0.0;
+  unsigned ncv=getNumberOfArguments();
+  bias.assign(ncv,0.0);
+  if(der) der->assign(ncv,0.0);
+  vector<double> xx(1);
   if(!grid_) {
+    // the biases and derivatives of all the CVs are packed in a single buffer
+    // so that a single reduction is needed
     unsigned stride=comm.Get_size();
     unsigned rank=comm.Get_rank();
-    for(unsigned i=rank; i<hills_[iarg].size(); i+=stride) {
-      bias += evaluateGaussian(iarg,cv,hills_[iarg][i],der);
+    vector<double> buffer(der?2*ncv:ncv,0.0);
+    for(unsigned iarg=0; iarg<ncv; ++iarg) {
+      xx[0]=cv[iarg];
+      double* pder=(der?&buffer[ncv+iarg]:NULL);
+      for(unsigned i=rank; i<hills_[iarg].size(); i+=stride) {
+        buffer[iarg] += evaluateGaussian(iarg,xx,hills_[iarg][i],pder);
+      }
+    }
+    comm.Sum(buffer);
+    for(unsigned iarg=0; iarg<ncv; ++iarg) {
+      bias[iarg]=buffer[iarg];
+      if(der) (*der)[iarg]=buffer[ncv+iarg];
     }
-    comm.Sum(bias);
-    if(der) comm.Sum(der,1);
   } else {
-    if(der) {
-      vector<double> vder(1);
-      bias = BiasGrids_[iarg]->getValueAndDerivatives(cv,vder);
-      der[0] = vder[0];
-    } else {
-      bias = BiasGrids_[iarg]->getValue(cv);
+    vector<double> vder(1);
+    for(unsigned iarg=0; iarg<ncv; ++iarg) {
+      xx[0]=cv[iarg];
+      if(der) {
+        bias[iarg] = BiasGrids_[iarg]->getValueAndDerivatives(xx,vder);
+        (*der)[iarg] = vder[0];
+      } else {
+        bias[iarg] = BiasGrids_[iarg]->getValue(xx);
+      }
     }
   }
-
-  return bias;
 }
 
 double PBMetaD::evaluateGaussian(unsigned iarg, const vector<double>& cv, const Gaussian& hill, double* der)
@@ -966,18 +1016,15 @@ void PBMetaD::calculate()
   // on adaptive hills (diff) after exchanges:
   if(adaptive_==FlexibleBin::diffusion && getExchangeStep()) error("ADAPTIVE=DIFF is not compatible with replica exchange");
 
-  vector<double> cv(1);
-  double der[1];
+  vector<double> cv(getNumberOfArguments());
   vector<double> bias(getNumberOfArguments());
   vector<double> deriv(getNumberOfArguments());
 
   double ncv = (double) getNumberOfArguments();
   double bmin = 1.0e+19;
+  for(unsigned i=0; i<getNumberOfArguments(); ++i) cv[i] = getArgument(i);
+  getBiasAndDerivatives(cv, bias, &deriv);
   for(unsigned i=0; i<getNumberOfArguments(); ++i) {
-    cv[0] = getArgument(i);
-    der[0] = 0.0;
-    bias[i] = getBiasAndDerivatives(i, cv, der);
-    deriv[i] = der[0];
     if(bias[i] < bmin) bmin = bias[i];
   }
   double ene = 0.;
@@ -1029,8 +1076,9 @@ void PBMetaD::update()
       if(adaptive_!=FlexibleBin::none) thissigma[i]=flexbin[i].getInverseMatrix(i)[0];
       else thissigma[i]=sigma0_[i];
       cv[i]     = getArgument(i);
-      cv_tmp[0] = getArgument(i);
-      bias[i] = getBiasAndDerivatives(i, cv_tmp);
+    }
+    getBiasAndDerivatives(cv, bias);
+    for(unsigned i=0; i<getNumberOfArguments(); ++i) {
       if(bias[i] < bmin) bmin = bias[i];
     }
     // calculate heights and norm
@@ -1045,38 +1093,34 @@ void PBMetaD::update()
       if(welltemp_) height[i] *= exp(-bias[i]/(kbt_*(biasf_-1.0)));
     }
 
+    // the hills of all the CVs are added together
+    vector<unsigned> hills_arg;
+    vector<Gaussian> hills;
     // MPI Multiple walkers: share hills and add them all
     if(walkers_mpi) {
-      // Allocate arrays to store all walkers hills
-      std::vector<double> all_cv(mpi_nw_*cv.size(), 0.0);
-      std::vector<double> all_sigma(mpi_nw_*getNumberOfArguments(), 0.0);
-      std::vector<double> all_height(mpi_nw_*height.size(), 0.0);
+      // Pack cv, sigma and height of all walkers hills in a single array
+      unsigned ncv = getNumberOfArguments();
+      std::vector<double> all_hills(3*mpi_nw_*ncv, 0.0);
       if(comm.Get_rank()==0) {
         // fill in value
-        for(unsigned i=0; i<getNumberOfArguments(); ++i) {
-          unsigned j = mpi_id_ * getNumberOfArguments() + i;
-          all_cv[j] = cv[i];
-          all_sigma[j]  = thissigma[i];
-          all_height[j] = height[i];
+        for(unsigned i=0; i<ncv; ++i) {
+          unsigned j = 3 * (mpi_id_ * ncv + i);
+          all_hills[j]   = cv[i];
+          all_hills[j+1] = thissigma[i];
+          all_hills[j+2] = height[i];
         }
         // Communicate (only root)
-        multi_sim_comm.Sum(&all_cv[0], all_cv.size());
-        multi_sim_comm.Sum(&all_sigma[0], all_sigma.size());
-        multi_sim_comm.Sum(&all_height[0], all_height.size());
+        multi_sim_comm.Sum(all_hills);
       }
       // Share info with group members
-      comm.Sum(&all_cv[0], all_cv.size());
-      comm.Sum(&all_sigma[0], all_sigma.size());
-      comm.Sum(&all_height[0], all_height.size());
-      // now add hills one by one
+      comm.Sum(all_hills);
       for(unsigned j=0; j<mpi_nw_; ++j) {
-        for(unsigned i=0; i<getNumberOfArguments(); ++i) {
-          cv_tmp[0]    = all_cv[j*cv.size()+i];
-          double height_tmp = all_height[j*cv.size()+i];
-          sigma_tmp[0] = all_sigma[j*cv.size()+i];
-          Gaussian newhill = Gaussian(cv_tmp, sigma_tmp, height_tmp, multivariate);
-          addGaussian(i, newhill);
-          writeGaussian(i, newhill, hillsOfiles_[i]);
+        for(unsigned i=0; i<ncv; ++i) {
+          unsigned k = 3 * (j * ncv + i);
+          cv_tmp[0]    = all_hills[k];
+          sigma_tmp[0] = all_hills[k+1];
+          hills_arg.push_back(i);
+          hills.push_back(Gaussian(cv_tmp, sigma_tmp, all_hills[k+2], multivariate));
         }
       }
       // just add your own hills
@@ -1085,11 +1129,12 @@ void PBMetaD::update()
         cv_tmp[0] = cv[i];
         if(adaptive_!=FlexibleBin::none) sigma_tmp[0]=thissigma[i];
         else sigma_tmp[0] = sigma0_[i];
-        Gaussian newhill = Gaussian(cv_tmp, sigma_tmp, height[i], multivariate);
-        addGaussian(i, newhill);
-        writeGaussian(i, newhill, hillsOfiles_[i]);
+        hills_arg.push_back(i);
+        hills.push_back(Gaussian(cv_tmp, sigma_tmp, height[i], multivariate));
       }
     }
+    addGaussians(hills_arg, hills);
+    for(unsigned k=0; k<hills.size(); ++k) writeGaussian(hills_arg[k], hills[k], hillsOfiles_[hills_arg[k]]);
   }
 
   // write grid files
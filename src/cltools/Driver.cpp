@@ -31,6 +31,11 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
 #include "tools/Units.h"
 #include "tools/PDB.h"
 #include "tools/FileBase.h"
@@ -174,6 +179,28 @@ Notice that the xdrfile implementation of xtc and trr
 is more robust than the molfile one, since it provides support for generic cell shapes.
 In addition, it allows \ref DUMPATOMS to write compressed xtc files.
 
+Long trajectories can be analyzed in parallel with the `--parallel-frames` option.
+The trajectory is split in blocks of consecutive frames, one for each MPI process,
+and each process runs an independent instance of PLUMED on its block. Output files are written by each
+process with a suffix equal to its rank (e.g. `colvar.0`, `colvar.1`, ...). The files listed
+with `--merge-files` are concatenated in frame order at the end of the run, keeping only the header of the first block:
+\verbatim
+mpirun -np 8 plumed driver --plumed plumed.dat --mf_xtc traj.xtc --parallel-frames --merge-files colvar
+\endverbatim
+Notice that this is only correct for actions that do not depend on the history of the
+simulation, e.g. it is fine for \ref PRINT but not for \ref METAD.
+The first process counts the frames before the analysis starts. With xyz and gro files
+it also records where each block starts, so that the other processes move there directly.
+With molfile plugins the preceding frames are skipped without reading the coordinates, whereas
+the xdrfile library has to decode them.
+
+When the calculation is cheap, most of the time can be spent reading (and decompressing) the trajectory.
+With `--prefetch-frames` a background thread reads the following frames while PLUMED is
+analyzing the current one:
+\verbatim
+plumed driver --plumed plumed.dat --mf_xtc traj.xtc --prefetch-frames 4
+\endverbatim
+The argument is the number of frames that are kept in memory in advance.
 
 */
 //+ENDPLUMEDOC
@@ -195,6 +222,126 @@ static int register_cb(void *v, vmdplugin_t *p) {
 }
 #endif
 
+/// Data of a trajectory frame as read from file, before it is parsed
+struct DriverFrame {
+/// lines of xyz and gro files
+  std::vector<std::string> lines;
+#ifdef __PLUMED_HAS_MOLFILE_PLUGINS
+  molfile_timestep_t ts;
+  std::vector<float> coords;
+#endif
+#ifdef __PLUMED_HAS_XDRFILE
+  int localstep;
+  float time,prec,lambda;
+  matrix box;
+  std::unique_ptr<rvec[]> pos;
+#endif
+};
+
+/// Reads frames in advance in a background thread, storing them in a ring of
+/// buffers that are reused. In this way the trajectory is read and decompressed
+/// while plumed is calculating. With no buffered frames, or if threads cannot be
+/// started, frames are read when requested.
+class FramePrefetcher {
+  std::function<bool(DriverFrame&)> reader;
+  std::vector<DriverFrame> ring;
+/// first frame to be used, and number of frames ready to be used
+  unsigned head,count;
+  bool finished,stopping,threaded;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread worker;
+  void run();
+public:
+  FramePrefetcher(const std::function<bool(DriverFrame&)>& reader,unsigned nbuffered);
+  ~FramePrefetcher();
+/// Get the next frame, NULL at the end of the trajectory.
+/// The frame can be used until release() is called.
+  DriverFrame* next();
+/// Release the current frame
+  void release();
+/// Check if frames are being read in a background thread
+  bool isThreaded() const {return threaded;}
+};
+
+inline FramePrefetcher::FramePrefetcher(const std::function<bool(DriverFrame&)>& reader,unsigned nbuffered):
+  reader(reader),
+  ring(nbuffered>0?nbuffered:1),
+  head(0),
+  count(0),
+  finished(false),
+  stopping(false),
+  threaded(false)
+{
+  if(nbuffered>0) {
+    try {
+      worker=std::thread(&FramePrefetcher::run,this);
+      threaded=true;
+    } catch(const std::system_error&) {
+      // fall back to synchronous reading
+    }
+  }
+}
+
+inline FramePrefetcher::~FramePrefetcher() {
+  if(threaded) {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stopping=true;
+    }
+    cv.notify_all();
+    worker.join();
+  }
+}
+
+inline void FramePrefetcher::run() {
+  while(true) {
+    unsigned tail;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock,[this] {return stopping || count<ring.size();});
+      if(stopping) return;
+      tail=(head+count)%ring.size();
+    }
+// the slot is not visible to the main thread until count is increased
+    bool ok=reader(ring[tail]);
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if(ok) count++;
+      else finished=true;
+    }
+    cv.notify_all();
+    if(!ok) return;
+  }
+}
+
+inline DriverFrame* FramePrefetcher::next() {
+  if(!threaded) {
+    if(count==0) {
+      if(finished || !reader(ring[0])) {
+        finished=true;
+        return NULL;
+      }
+      count=1;
+    }
+    return &ring[0];
+  }
+  std::unique_lock<std::mutex> lock(mtx);
+  cv.wait(lock,[this] {return count>0 || finished;});
+  if(count==0) return NULL;
+  return &ring[head];
+}
+
+inline void FramePrefetcher::release() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    plumed_assert(count>0);
+    head=(head+1)%ring.size();
+    count--;
+  }
+  if(threaded) cv.notify_all();
+}
+
 template<typename real>
 class Driver : public CLTool {
 public:
@@ -220,7 +367,10 @@ void Driver<real>::registerKeywords( Keywords& keys ) {
 #endif
           );
   keys.add("compulsory","--multi","0","set number of replicas for multi environment (needs mpi)");
+  keys.addFlag("--parallel-frames",false,"split the trajectory in blocks of consecutive frames that are analyzed independently by the MPI processes (needs mpi)");
+  keys.add("optional","--merge-files","with --parallel-frames, comma-separated list of output files to be merged in frame order at the end");
   keys.addFlag("--noatoms",false,"don't read in a trajectory.  Just use colvar files as specified in plumed.dat");
+  keys.add("compulsory","--prefetch-frames","0","number of frames read in advance by a background thread while plumed is calculating (0 means that frames are read when needed)");
   keys.add("atoms","--ixyz","the trajectory in xyz format");
   keys.add("atoms","--igro","the trajectory in gro format");
 #ifdef __PLUMED_HAS_XDRFILE
@@ -303,6 +453,16 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
 // set up for multi replica driver:
   int multi=0;
   parse("--multi",multi);
+// set up for parallel analysis of blocks of frames:
+  bool parallel_frames; parseFlag("--parallel-frames",parallel_frames);
+  vector<string> mergefiles;
+  if(parallel_frames) {
+    if(multi) error("cannot use --parallel-frames and --multi at the same time");
+    if(noatoms) error("--parallel-frames needs a trajectory");
+    if(debug_pd || debug_dd) error("cannot use --parallel-frames and domain/particle decomposition at the same time");
+    string merge; parse("--merge-files",merge);
+    if(merge.length()>0) mergefiles=Tools::getWords(merge,",");
+  }
   Communicator intracomm;
   Communicator intercomm;
   if(multi) {
@@ -311,6 +471,9 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
     if(multi*nintra!=ntot) error("invalid number of processes for multi environment");
     pc.Split(pc.Get_rank()/nintra,pc.Get_rank(),intracomm);
     pc.Split(pc.Get_rank()%nintra,pc.Get_rank(),intercomm);
+  } else if(parallel_frames && Communicator::initialized()) {
+// every process runs its own instance of plumed
+    pc.Split(pc.Get_rank(),0,intracomm);
   } else {
     intracomm.Set_comm(pc.Get_comm());
   }
@@ -358,10 +521,8 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
   molfile_plugin_t *api=NULL;
   void *h_in=NULL;
   molfile_timestep_t ts_in; // this is the structure that has the timestep
-// a std::unique_ptr<float> with the same scope as ts_in
-// it is necessary in order to store the pointer to ts_in.coords
-  std::unique_ptr<float[]> ts_in_coords;
-  ts_in.coords=ts_in_coords.get();
+// coordinates are stored in the buffers of the frame prefetcher
+  ts_in.coords=NULL;
   ts_in.A=-1; // we use this to check whether cell is provided or not
 #endif
 
@@ -467,6 +628,15 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
     if( !Communicator::initialized() ) error("needs mpi for debug-pd");
   }
 
+// with --parallel-frames only the first process writes the log
+// (declared before p, so that it is closed after plumed has been finalized)
+  std::unique_ptr<FILE,int(*)(FILE*)> null_log(NULL,fclose);
+  FILE* fp_log=out;
+  if(parallel_frames && pc.Get_rank()>0) {
+    null_log.reset(fopen("/dev/null","w"));
+    fp_log=null_log.get();
+  }
+
   Plumed p;
   int rr=sizeof(real);
   p.cmd("setRealPrecision",&rr);
@@ -487,8 +657,9 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
   p.cmd("setMDMassUnits",&units.getMass());
   p.cmd("setMDEngine","driver");
   p.cmd("setTimestep",&timestep);
-  p.cmd("setPlumedDat",plumedFile.c_str());
-  p.cmd("setLog",out);
+// with --parallel-frames the input file is read after init, once the file suffix is set
+  if(!parallel_frames) p.cmd("setPlumedDat",plumedFile.c_str());
+  p.cmd("setLog",fp_log);
 
   int natoms;
 
@@ -514,8 +685,6 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
           if(command_line_natoms>=0) natoms=command_line_natoms;
           else error("this file format does not provide number of atoms; use --natoms on the command line");
         }
-        ts_in_coords.reset(new float [3*natoms]);
-        ts_in.coords = ts_in_coords.get();
 #endif
       } else if(trajectory_fmt=="xdr-xtc" || trajectory_fmt=="xdr-trr") {
 #ifdef __PLUMED_HAS_XDRFILE
@@ -558,6 +727,159 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
   }
 
   std::string line;
+
+// with --parallel-frames, every process analyzes the frames in [frameFirst,frameLast).
+// The frames before the block of a process are skipped here without being converted:
+// for xyz and gro files rank 0 records where each block starts so that the other
+// processes can just seek there
+  int iframe=0, frameFirst=0, frameLast=0, nframes=0;
+  if(parallel_frames) {
+    if(trajectoryFile=="-") error("--parallel-frames cannot read the trajectory from standard input");
+    const int np=pc.Get_size(), rank=pc.Get_rank();
+    const bool textfile=!use_molfile && trajectory_fmt!="xdr-xtc" && trajectory_fmt!="xdr-trr";
+    std::vector<long unsigned> offsets;
+    if(rank==0) {
+      if(use_molfile) {
+#ifdef __PLUMED_HAS_MOLFILE_PLUGINS
+        int nat;
+        void* h_count=api->open_file_read(trajectoryFile.c_str(),trajectory_fmt.c_str(),&nat);
+        if(!h_count) error("cannot open trajectory file "+trajectoryFile);
+// a NULL timestep skips the frame
+        while(api->read_next_timestep(h_count,natoms,NULL)==MOLFILE_SUCCESS) nframes++;
+        api->close_file_read(h_count);
+#endif
+      } else if(!textfile) {
+#ifdef __PLUMED_HAS_XDRFILE
+        XDRFILE* xd_count=xdrfile_open(trajectoryFile.c_str(),"r");
+        if(!xd_count) error("cannot open trajectory file "+trajectoryFile);
+        int localstep; float time,prec,lambda; matrix box;
+        std::unique_ptr<rvec[]> pos(new rvec[natoms]);
+        while(true) {
+          int ret;
+          if(trajectory_fmt=="xdr-xtc") ret=read_xtc(xd_count,natoms,&localstep,&time,box,pos.get(),&prec);
+          else ret=read_trr(xd_count,natoms,&localstep,&time,&lambda,box,pos.get(),NULL,NULL);
+          if(ret!=exdrOK) break;
+          nframes++;
+        }
+        xdrfile_close(xd_count);
+#endif
+      } else {
+        FILE* fp_count=fopen(trajectoryFile.c_str(),"r");
+        if(!fp_count) error("cannot open trajectory file "+trajectoryFile);
+        std::string cline;
+        while(true) {
+          long unsigned offset=ftell(fp_count);
+          if(!Tools::getline(fp_count,cline)) break;
+          if(trajectory_fmt=="gro") if(!Tools::getline(fp_count,cline)) break;
+          int nat=0;
+          sscanf(cline.c_str(),"%100d",&nat);
+// atoms plus box line, both for xyz and gro
+          bool complete=true;
+          for(int i=0; i<nat+1; i++) if(!Tools::getline(fp_count,cline)) { complete=false; break; }
+          if(!complete) break;
+          offsets.push_back(offset);
+          nframes++;
+        }
+        fclose(fp_count);
+      }
+    }
+    pc.Bcast(nframes,0);
+    frameFirst=static_cast<int>((static_cast<long long>(nframes)*rank)/np);
+    frameLast=static_cast<int>((static_cast<long long>(nframes)*(rank+1))/np);
+    fprintf(out,"\nDRIVER: analyzing frames from %d to %d out of %d\n",frameFirst,frameLast-1,nframes);
+    if(textfile) {
+// offset of the first frame of each block (processes without frames do not read)
+      std::vector<long unsigned> blockStart(np,0);
+      if(rank==0) for(int r=0; r<np; r++) {
+          int first=static_cast<int>((static_cast<long long>(nframes)*r)/np);
+          if(first<nframes) blockStart[r]=offsets[first];
+        }
+      pc.Bcast(blockStart,0);
+      if(frameFirst<frameLast && fseek(fp,blockStart[rank],SEEK_SET)!=0) error("cannot seek in trajectory file "+trajectoryFile);
+    } else if(use_molfile) {
+#ifdef __PLUMED_HAS_MOLFILE_PLUGINS
+      for(int i=0; i<frameFirst; i++) if(api->read_next_timestep(h_in,natoms,NULL)!=MOLFILE_SUCCESS) error("premature end of trajectory file");
+#endif
+    } else {
+#ifdef __PLUMED_HAS_XDRFILE
+// xdrfile cannot seek, so that the preceding frames have to be decoded
+      int localstep; float time,prec,lambda; matrix box;
+      std::unique_ptr<rvec[]> pos(new rvec[natoms]);
+      for(int i=0; i<frameFirst; i++) {
+        int ret;
+        if(trajectory_fmt=="xdr-xtc") ret=read_xtc(xd,natoms,&localstep,&time,box,pos.get(),&prec);
+        else ret=read_trr(xd,natoms,&localstep,&time,&lambda,box,pos.get(),NULL,NULL);
+        if(ret!=exdrOK) error("premature end of trajectory file");
+      }
+#endif
+    }
+    iframe=frameFirst;
+    step+=static_cast<long int>(frameFirst)*stride;
+  }
+
+// the reader of the raw frames, possibly working in a background thread
+  unsigned nprefetch; parse("--prefetch-frames",nprefetch);
+  std::unique_ptr<FramePrefetcher> prefetcher;
+  if(!noatoms) {
+    std::function<bool(DriverFrame&)> reader;
+    if(use_molfile) {
+#ifdef __PLUMED_HAS_MOLFILE_PLUGINS
+// plugins do not set the cell when it is missing in a frame, so that
+// the one of the previous frame is used. The last read timestep is thus kept here
+      std::shared_ptr<molfile_timestep_t> ts_last(new molfile_timestep_t(ts_in));
+      reader=[&,ts_last](DriverFrame& f) {
+        f.coords.resize(3*natoms);
+        f.ts=*ts_last;
+        f.ts.coords=f.coords.data();
+        if(api->read_next_timestep(h_in,natoms,&f.ts)!=MOLFILE_SUCCESS) return false;
+        *ts_last=f.ts;
+        return true;
+      };
+#endif
+    } else if(trajectory_fmt=="xdr-xtc" || trajectory_fmt=="xdr-trr") {
+#ifdef __PLUMED_HAS_XDRFILE
+      reader=[&](DriverFrame& f) {
+        if(!f.pos) f.pos.reset(new rvec[natoms]);
+        int ret;
+        if(trajectory_fmt=="xdr-xtc") ret=read_xtc(xd,natoms,&f.localstep,&f.time,f.box,f.pos.get(),&f.prec);
+        else ret=read_trr(xd,natoms,&f.localstep,&f.time,&f.lambda,f.box,f.pos.get(),NULL,NULL);
+        return ret==exdrOK;
+      };
+#endif
+    } else {
+// read the lines of a frame, parsing is done later
+      bool gro=(trajectory_fmt=="gro");
+      reader=[fp,gro](DriverFrame& f) {
+        f.lines.clear();
+        std::string l;
+        if(!Tools::getline(fp,l)) return false;
+        f.lines.push_back(l);
+        if(gro) {
+          if(!Tools::getline(fp,l)) return true;
+          f.lines.push_back(l);
+        }
+        int nat=0;
+        sscanf(f.lines.back().c_str(),"%100d",&nat);
+// atoms plus box line, both for xyz and gro
+        for(int i=0; i<nat+1; i++) {
+          if(!Tools::getline(fp,l)) break;
+          f.lines.push_back(l);
+        }
+        return true;
+      };
+    }
+    prefetcher.reset(new FramePrefetcher(reader,nprefetch));
+    if(prefetcher->isThreaded()) fprintf(out,"\nDRIVER: reading up to %u frames in advance\n",nprefetch);
+  }
+  DriverFrame* frame=NULL;
+  unsigned iline=0;
+// next line of a xyz or gro frame
+  auto nextline=[&](std::string& l) {
+    if(iline>=frame->lines.size()) return false;
+    l=frame->lines[iline++];
+    return true;
+  };
+
   std::vector<real> coordinates;
   std::vector<real> forces;
   std::vector<real> masses;
@@ -581,28 +903,25 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
   Random rnd;
 
   while(true) {
+    if(parallel_frames && iframe>=frameLast) break;
     if(!noatoms) {
+      if(frame) prefetcher->release();
+      frame=prefetcher->next();
+      if(!frame) break;
       if(use_molfile==true) {
 #ifdef __PLUMED_HAS_MOLFILE_PLUGINS
-        int rc;
-        rc = api->read_next_timestep(h_in, natoms, &ts_in);
-        //if(rc==MOLFILE_SUCCESS){
-        //       printf(" read this one :success \n");
-        //}
-        if(rc==MOLFILE_EOF) {
-          //printf(" read this one :eof or error \n");
-          break;
-        }
+        ts_in=frame->ts;
 #endif
       } else if(trajectory_fmt=="xyz" || trajectory_fmt=="gro") {
-        if(!Tools::getline(fp,line)) break;
+        iline=0;
+        if(!nextline(line)) break;
       }
     }
 
     bool first_step=false;
     if(!noatoms) {
       if(use_molfile==false && (trajectory_fmt=="xyz" || trajectory_fmt=="gro")) {
-        if(trajectory_fmt=="gro") if(!Tools::getline(fp,line)) error("premature end of trajectory file");
+        if(trajectory_fmt=="gro") if(!nextline(line)) error("premature end of trajectory file");
         sscanf(line.c_str(),"%100d",&natoms);
       }
     }
@@ -638,6 +957,14 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
       checknatoms=natoms;
       p.cmd("setNatoms",&natoms);
       p.cmd("init");
+      if(parallel_frames) {
+// each process writes its own output files, distinguished by a suffix
+        string n; Tools::convert(pc.Get_rank(),n);
+        string suffix="_SET_SUFFIX ."+n;
+        p.cmd("readInputLine",suffix.c_str());
+        string include="INCLUDE FILE="+plumedFile;
+        p.cmd("readInputLine",include.c_str());
+      }
     }
     if(checknatoms!=natoms) {
       std::string stepstr; Tools::convert(step,stepstr);
@@ -740,24 +1067,14 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
 #endif
       } else if(trajectory_fmt=="xdr-xtc" || trajectory_fmt=="xdr-trr") {
 #ifdef __PLUMED_HAS_XDRFILE
-        int localstep;
-        float time;
-        matrix box;
-        std::unique_ptr<rvec[]> pos(new rvec[natoms]);
-        float prec,lambda;
-        int ret;
-        if(trajectory_fmt=="xdr-xtc") ret=read_xtc(xd,natoms,&localstep,&time,box,pos.get(),&prec);
-        if(trajectory_fmt=="xdr-trr") ret=read_trr(xd,natoms,&localstep,&time,&lambda,box,pos.get(),NULL,NULL);
-        if(stride==0) step=localstep;
-        if(ret==exdrENDOFFILE) break;
-        if(ret!=exdrOK) break;
-        for(unsigned i=0; i<3; i++) for(unsigned j=0; j<3; j++) cell[3*i+j]=box[i][j];
+        if(stride==0) step=frame->localstep;
+        for(unsigned i=0; i<3; i++) for(unsigned j=0; j<3; j++) cell[3*i+j]=frame->box[i][j];
         for(unsigned i=0; i<natoms; i++) for(unsigned j=0; j<3; j++)
-            coordinates[3*i+j]=real(pos[i][j]);
+            coordinates[3*i+j]=real(frame->pos[i][j]);
 #endif
       } else {
         if(trajectory_fmt=="xyz") {
-          if(!Tools::getline(fp,line)) error("premature end of trajectory file");
+          if(!nextline(line)) error("premature end of trajectory file");
 
           std::vector<double> celld(9,0.0);
           if(pbc_cli_given==false) {
@@ -779,7 +1096,7 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
         int ddist=0;
         // Read coordinates
         for(int i=0; i<natoms; i++) {
-          bool ok=Tools::getline(fp,line);
+          bool ok=nextline(line);
           if(!ok) error("premature end of trajectory file");
           double cc[3];
           if(trajectory_fmt=="xyz") {
@@ -813,7 +1130,7 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
           }
         }
         if(trajectory_fmt=="gro") {
-          if(!Tools::getline(fp,line)) error("premature end of trajectory file");
+          if(!nextline(line)) error("premature end of trajectory file");
           std::vector<string> words=Tools::getWords(line);
           if(words.size()<3) error("cannot understand box format");
           Tools::convert(words[0],cell[0]);
@@ -936,8 +1253,44 @@ int Driver<real>::main(FILE* in,FILE*out,Communicator& pc) {
     if(noatoms && plumedStopCondition) break;
 
     step+=stride;
+    iframe++;
+  }
+// processes without frames have not initialized plumed
+  const bool initialized=(!parallel_frames || frameFirst<frameLast);
+  if(initialized) p.cmd("runFinalJobs");
+// stop reading before closing the files
+  prefetcher.reset();
+
+  if(parallel_frames) {
+// delete all the actions so as to close their files
+    if(initialized) p.cmd("clear");
+    pc.Barrier();
+// concatenate the files written by the processes, keeping only the first header
+    if(pc.Get_rank()==0) {
+      for(const auto & name : mergefiles) {
+        OFile merged;
+        merged.open(name);
+        bool header=true;
+        for(int r=0; r<pc.Get_size(); r++) {
+// there are no files for processes without frames
+          if((static_cast<long long>(nframes)*r)/pc.Get_size()==(static_cast<long long>(nframes)*(r+1))/pc.Get_size()) continue;
+          string n; Tools::convert(r,n);
+          string piece=FileBase::appendSuffix(name,"."+n);
+          FILE* fp_piece=fopen(piece.c_str(),"r");
+          if(!fp_piece) error("cannot find file "+piece+" to be merged");
+          string mline;
+          while(Tools::getline(fp_piece,mline)) {
+            if(!header && mline.compare(0,2,"#!")==0) continue;
+            merged.printf("%s\n",mline.c_str());
+          }
+          header=false;
+          fclose(fp_piece);
+          remove(piece.c_str());
+        }
+        merged.close();
+      }
+    }
   }
-  p.cmd("runFinalJobs");
 
   if(fp_forces) fclose(fp_forces);
   if(debugforces.length()>0) fp_dforces.close();
@@ -107,6 +107,15 @@ plumed sum_hills --negbias --hills PATHTOMYHILLSFILE
 
 Here the default name will be negativebias.dat
 
+Hills are read in blocks and each block is summed on the grid in parallel.
+The number of threads is controlled by the PLUMED_NUM_THREADS environment variable
+and the tool can also be run with mpirun. In both cases the result
+is identical to the one obtained in serial
+
+\verbatim
+PLUMED_NUM_THREADS=4 mpirun -np 2 plumed sum_hills --hills PATHTOMYHILLSFILE
+\endverbatim
+
 From time to time you might need to use HILLS or a COLVAR file
 as it was just a simple set  of points from which you want to build
 a free energy by using -(1/beta)log(P)
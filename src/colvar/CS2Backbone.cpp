@@ -24,6 +24,7 @@
 #define cutOffDist    0.50  	// cut off distance for non-bonded pairwise forces
 #define cutOnDist     0.32   	// cut off distance for non-bonded pairwise forces
 #define cutOffNB2     cutOffNB*cutOffNB // squared buffer distance for neighbour-lists 
+#define cutOffSkin2   0.25*(cutOffNB-cutOffDist)*(cutOffNB-cutOffDist) // squared displacement triggering a neighbour-list update
 #define cutOffDist2   cutOffDist*cutOffDist
 #define cutOnDist2    cutOnDist*cutOnDist
 #define invswitch     1.0/((cutOffDist2-cutOnDist2)*(cutOffDist2-cutOnDist2)*(cutOffDist2-cutOnDist2))
@@ -34,12 +35,16 @@
 #include <fstream>
 #include <iterator>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
 
 #include "Colvar.h"
 #include "ActionRegister.h"
 #include "core/PlumedMain.h"
 #include "tools/OpenMP.h"
 #include "tools/Pbc.h"
+#include "tools/LinkCells.h"
+#include "tools/Communicator.h"
 #include "tools/PDB.h"
 #include "tools/Torsion.h"
 
@@ -109,6 +114,10 @@ and can be found in regtest/basic/rt45/data/ .
 
 All the above files must be in a single folder that must be specified with the keyword DATA.
 
+The list of non-bonded neighbours of each residue is updated whenever an atom has moved by more than
+half of the buffer distance (0.1 nm) since the last update, so that it is always complete. With NEIGH_FREQ
+it is possible to also force an update with a fixed period.
+
 Additional material and examples can be also found in the tutorial \ref belfast-9
 
 \par Examples
@@ -403,7 +412,6 @@ class CS2Backbone : public Colvar {
     vector<int> side_chain;
     vector<int> xd1;
     vector<int> xd2;
-    vector<unsigned> box_nb;
     vector<int> phi;
     vector<int> psi;
     vector<int> chi1;
@@ -426,7 +434,6 @@ class CS2Backbone : public Colvar {
       side_chain.reserve(20);
       xd1.reserve(27);
       xd2.reserve(27);
-      box_nb.reserve(250);
       phi.reserve(4);
       psi.reserve(4);
       chi1.reserve(4);
@@ -456,6 +463,15 @@ class CS2Backbone : public Colvar {
     {for(unsigned i=0; i<6; i++) atom[i]=0;}
   };
 
+/// Scratch buffers reused by each thread in calculate()
+  struct Scratch {
+    vector<Vector>   ext_distances;
+    vector<double>   ext_d;
+    vector<unsigned> list;
+    vector<Vector>   ff;
+    vector<Vector>   deriv;
+  };
+
   enum aa_t {ALA, ARG, ASN, ASP, CYS, GLN, GLU, GLY, HIS, ILE, LEU, LYS, MET, PHE, PRO, SER, THR, TRP, TYR, VAL, UNK};
   enum atom_t {D_C, D_H, D_N, D_O, D_S, D_C2, D_N2, D_O2};
 
@@ -465,13 +481,23 @@ class CS2Backbone : public Colvar {
   vector<unsigned> seg_last;
   vector<unsigned> type;
   vector<unsigned> res_num;
+/// chain and residue of the fragments for which chemical shifts are calculated,
+/// i.e. all of them but the first and the last of each chain
+  vector<pair<unsigned,unsigned> > frags;
+/// neighbour lists of all the fragments, those of frags[f] are
+/// box_nb[box_nb_start[f]] ... box_nb[box_nb_start[f+1]-1]
+  vector<unsigned> box_nb_start;
+  vector<unsigned> box_nb;
+  vector<Scratch>  scratch;
   unsigned         box_nupdate;
   unsigned         box_count;
+  vector<Vector>   box_positions;
   bool             camshift;
   bool             pbc;
 
   void remove_problematic(const string &res, const string &nucl);
   void read_cs(const string &file, const string &k);
+  bool needs_neighb_update();
   void update_neighb();
   void compute_ring_parameters();
   void compute_dihedrals();
@@ -505,7 +531,7 @@ void CS2Backbone::registerKeywords( Keywords& keys ) {
   keys.add("atoms","ATOMS","The atoms to be included in the calculation, e.g. the whole protein.");
   keys.add("compulsory","DATA","data/","The folder with the experimental chemical shifts.");
   keys.add("compulsory","TEMPLATE","template.pdb","A PDB file of the protein system to initialise ALMOST.");
-  keys.add("compulsory","NEIGH_FREQ","20","Period in step for neighbour list update.");
+  keys.add("compulsory","NEIGH_FREQ","0","Period in step for forced neighbour list updates (0 means that the list is only updated when atoms move more than the buffer distance allows).");
   keys.add("compulsory","NRES","Number of residues, corresponding to the number of chemical shifts.");
   keys.addFlag("CAMSHIFT",false,"Set to TRUE if you to calculate a single CamShift score.");
   keys.addFlag("NOEXP",false,"Set to TRUE if you don't want to have fixed components with the experimetnal values.");
@@ -547,7 +573,7 @@ CS2Backbone::CS2Backbone(const ActionOptions&ao):
   parse("TEMPLATE",stringa_template);
 
   box_count=0;
-  box_nupdate=20;
+  box_nupdate=0;
   parse("NEIGH_FREQ", box_nupdate);
 
   unsigned numResidues;
@@ -692,6 +718,10 @@ CS2Backbone::CS2Backbone(const ActionOptions&ao):
   /* temporary check, the idea is that I can remove NRES completely */
   if(index!=numResidues) error("NRES and the number of residues in the PDB do not match!");
 
+  for(unsigned s=0; s<atom.size(); s++) {
+    for(unsigned a=1; a+1<atom[s].size(); a++) frags.push_back(pair<unsigned,unsigned>(s,a));
+  }
+
   requestAtoms(atoms);
 }
 
@@ -759,7 +789,7 @@ void CS2Backbone::calculate()
 {
   if(pbc) makeWhole();
   if(getExchangeStep()) box_count=0;
-  if(box_count==0) update_neighb();
+  if(box_count==0 || needs_neighb_update()) update_neighb();
 
   compute_ring_parameters();
   compute_dihedrals();
@@ -774,30 +804,37 @@ void CS2Backbone::calculate()
   camshift_sigma2[4] = 1.56; // CB
   camshift_sigma2[5] = 1.70; // CO
 
-  const unsigned chainsize = atom.size();
-  const unsigned atleastned = 72+ringInfo.size()*6;
-
-  // CYCLE OVER MULTIPLE CHAINS
-  #pragma omp parallel num_threads(OpenMP::getNumThreads())
-  for(unsigned s=0; s<chainsize; s++) {
-    const unsigned psize = atom[s].size();
-    vector<Vector> omp_deriv;
-    if(camshift) omp_deriv.resize(getNumberOfAtoms(), Vector(0,0,0));
+  const unsigned nt = OpenMP::getNumThreads();
+  if(scratch.size()<nt) scratch.resize(nt);
+  const unsigned nfrags = frags.size();
+
+  // CYCLE OVER THE RESIDUES OF ALL THE CHAINS
+  #pragma omp parallel num_threads(nt)
+  {
+    Scratch & myscratch = scratch[OpenMP::getThreadNum()];
+    // the derivatives of all the nt buffers are zeroed, since the runtime can start fewer
+    // threads than requested and all the buffers are summed at the end
+    if(camshift) {
+      #pragma omp for
+      for(unsigned t=0; t<nt; t++) scratch[t].deriv.assign(getNumberOfAtoms(), Vector(0,0,0));
+    }
     #pragma omp for reduction(+:score)
-    // SKIP FIRST AND LAST RESIDUE OF EACH CHAIN
-    for(unsigned a=1; a<psize-1; a++) {
+    for(unsigned f=0; f<nfrags; f++) {
+      const unsigned s = frags[f].first;
+      const unsigned a = frags[f].second;
 
       const Fragment *myfrag = &atom[s][a];
       const unsigned aa_kind = myfrag->res_kind;
       const unsigned res_type_curr = myfrag->res_type_curr;
       const unsigned res_type_prev = myfrag->res_type_prev;
       const unsigned res_type_next = myfrag->res_type_next;
-      const unsigned needed_atoms = atleastned+myfrag->box_nb.size();
 
       /* Extra Distances are the same for each residue */
       const unsigned xdsize=myfrag->xd1.size();
-      vector<Vector> ext_distances(xdsize);
-      vector<double> ext_d(xdsize);
+      vector<Vector> & ext_distances = myscratch.ext_distances;
+      vector<double> & ext_d = myscratch.ext_d;
+      ext_distances.resize(xdsize);
+      ext_d.resize(xdsize);
       for(unsigned q=0; q<xdsize; q++) {
         if(myfrag->xd1[q]==-1||myfrag->xd2[q]==-1) continue;
         const Vector distance = delta(getPosition(myfrag->xd1[q]),getPosition(myfrag->xd2[q]));
@@ -819,11 +856,11 @@ void CS2Backbone::calculate()
           // this is the atom for which we are calculating the chemical shift
           const unsigned ipos = myfrag->pos[at_kind];
 
-          vector<unsigned> list;
-          list.reserve(needed_atoms);
+          vector<unsigned> & list = myscratch.list;
+          list.clear();
           list.push_back(ipos);
-          vector<Vector> ff;
-          ff.reserve(needed_atoms);
+          vector<Vector> & ff = myscratch.ff;
+          ff.clear();
           ff.push_back(Vector(0,0,0));
 
           //PREV
@@ -918,9 +955,9 @@ void CS2Backbone::calculate()
           {
             const double * CONST_CO_SPHERE3 = db.CO_SPHERE(aa_kind,at_kind,0);
             const double * CONST_CO_SPHERE  = db.CO_SPHERE(aa_kind,at_kind,1);
-            const unsigned boxsize = myfrag->box_nb.size();
-            for(unsigned bat=0; bat<boxsize; bat++) {
-              const unsigned jpos = myfrag->box_nb[bat];
+            const unsigned boxend = box_nb_start[f+1];
+            for(unsigned bat=box_nb_start[f]; bat<boxend; bat++) {
+              const unsigned jpos = box_nb[bat];
               const Vector distance = delta(getPosition(jpos),getPosition(ipos));
               const double d2 = distance.modulo2();
 
@@ -1109,17 +1146,18 @@ void CS2Backbone::calculate()
             comp = getPntrToValue();
             score += (cs - atom[s][a].exp_cs[at_kind])*(cs - atom[s][a].exp_cs[at_kind])/camshift_sigma2[at_kind];
             fact = 2.0*(cs - atom[s][a].exp_cs[at_kind])/camshift_sigma2[at_kind];
-            for(unsigned i=0; i<list.size(); i++) omp_deriv[list[i]] += fact*ff[i];
+            for(unsigned i=0; i<list.size(); i++) myscratch.deriv[list[i]] += fact*ff[i];
           }
         }
       }
     }
-    #pragma omp critical
-    if(camshift) for(int i=0; i<getPositions().size(); i++) setAtomsDerivatives(i,omp_deriv[i]);
   }
 
   // in the case of camshift we calculate the virial at the end
   if(camshift) {
+    for(unsigned t=0; t<nt; t++) {
+      for(unsigned i=0; i<getNumberOfAtoms(); i++) setAtomsDerivatives(i,scratch[t].deriv[i]);
+    }
     setBoxDerivativesNoPbc();
     setValue(score);
   }
@@ -1128,31 +1166,82 @@ void CS2Backbone::calculate()
   if(box_count == box_nupdate) box_count = 0;
 }
 
+bool CS2Backbone::needs_neighb_update() {
+  const unsigned natoms=getNumberOfAtoms();
+  if(box_positions.size()!=natoms) return true;
+  for(unsigned i=0; i<natoms; i++) {
+    if(delta(box_positions[i],getPosition(i)).modulo2()>cutOffSkin2) return true;
+  }
+  return false;
+}
+
 void CS2Backbone::update_neighb() {
-  const unsigned chainsize = atom.size();
-  for(unsigned s=0; s<chainsize; s++) {
-    const unsigned psize = atom[s].size();
-    #pragma omp parallel for num_threads(OpenMP::getNumThreads())
-    for(unsigned a=1; a<psize-1; a++) {
-      const unsigned boxsize = getNumberOfAtoms();
-      atom[s][a].box_nb.clear();
-      atom[s][a].box_nb.reserve(300);
-      const unsigned res_curr = res_num[atom[s][a].pos[0]];
-      for(unsigned bat=0; bat<boxsize; bat++) {
-        const unsigned res_dist = abs(static_cast<int>(res_curr-res_num[bat]));
-        if(res_dist<2) continue;
-        for(unsigned at_kind=0; at_kind<6; at_kind++) {
-          if(atom[s][a].exp_cs[at_kind]==0.) continue;
-          const unsigned ipos = atom[s][a].pos[at_kind];
-          const Vector distance = delta(getPosition(bat),getPosition(ipos));
-          const double d2=distance.modulo2();
-          if(d2<cutOffNB2) {
-            atom[s][a].box_nb.push_back(bat);
-            break;
-          }
+  const unsigned natoms=getNumberOfAtoms();
+  box_positions=getPositions();
+
+// All the atoms are binned once in cells enclosing them (distances are
+// calculated without pbc) and the neighbours of each nucleus are then
+// searched only in the surrounding cells
+  Vector lower=box_positions[0];
+  Vector upper=box_positions[0];
+  for(unsigned i=1; i<natoms; i++) for(unsigned k=0; k<3; k++) {
+      lower[k]=std::min(lower[k],box_positions[i][k]);
+      upper[k]=std::max(upper[k],box_positions[i][k]);
+    }
+  Tensor box;
+  for(unsigned k=0; k<3; k++) box(k,k)=upper[k]-lower[k]+cutOffNB;
+  Pbc cellpbc;
+  cellpbc.setBox(box);
+// cells are made larger than the cutoff when they would be more than the atoms
+  double cellsize=std::cbrt(box.determinant()/natoms);
+  if(cellsize<cutOffNB) cellsize=cutOffNB;
+
+  Communicator serial;
+  LinkCells cells(serial);
+  cells.setCutoff(cellsize);
+  vector<unsigned> indices(natoms);
+  for(unsigned i=0; i<natoms; i++) indices[i]=i;
+  cells.buildCellLists(box_positions,indices,cellpbc);
+
+// fragments are distributed among threads in contiguous blocks, so that
+// the lists found by each thread can then be copied in a single array
+  const unsigned nfrags=frags.size();
+  box_nb_start.assign(nfrags+1,0);
+  #pragma omp parallel num_threads(OpenMP::getNumThreads())
+  {
+    vector<unsigned> cells_required;
+    vector<unsigned> candidates(natoms+1);
+    vector<unsigned> mylist;
+    unsigned myfirst=nfrags;
+    #pragma omp for schedule(static)
+    for(unsigned f=0; f<nfrags; f++) {
+      if(myfirst==nfrags) myfirst=f;
+      const Fragment & myfrag=atom[frags[f].first][frags[f].second];
+      const unsigned begin=mylist.size();
+      const unsigned res_curr = res_num[myfrag.pos[0]];
+      for(unsigned at_kind=0; at_kind<6; at_kind++) {
+        if(myfrag.exp_cs[at_kind]==0.) continue;
+        const unsigned ipos = myfrag.pos[at_kind];
+        unsigned ncandidates=1; candidates[0]=ipos;
+        cells.retrieveNeighboringAtoms(getPosition(ipos),cells_required,ncandidates,candidates);
+        for(unsigned k=1; k<ncandidates; k++) {
+          const unsigned bat=candidates[k];
+          const unsigned res_dist = abs(static_cast<int>(res_curr-res_num[bat]));
+          if(res_dist<2) continue;
+          if(delta(getPosition(bat),getPosition(ipos)).modulo2()<cutOffNB2) mylist.push_back(bat);
         }
       }
+// atoms close to more nuclei are only stored once, in increasing order
+      std::sort(mylist.begin()+begin,mylist.end());
+      mylist.erase(std::unique(mylist.begin()+begin,mylist.end()),mylist.end());
+      box_nb_start[f+1]=mylist.size()-begin;
+    }
+    #pragma omp single
+    {
+      for(unsigned f=0; f<nfrags; f++) box_nb_start[f+1]+=box_nb_start[f];
+      box_nb.resize(box_nb_start[nfrags]);
     }
+    if(myfirst<nfrags) std::copy(mylist.begin(),mylist.end(),box_nb.begin()+box_nb_start[myfirst]);
   }
 }
 
@@ -1207,48 +1296,47 @@ void CS2Backbone::compute_ring_parameters() {
 }
 
 void CS2Backbone::compute_dihedrals() {
-  const unsigned chainsize = atom.size();
-  for(unsigned s=0; s<chainsize; s++) {
-    const unsigned psize = atom[s].size();
-    #pragma omp parallel for num_threads(OpenMP::getNumThreads())
-    for(unsigned a=1; a<psize-1; a++) {
-      const Fragment *myfrag = &atom[s][a];
-      if(myfrag->phi.size()==4) {
-        const Vector d0 = delta(getPosition(myfrag->phi[1]), getPosition(myfrag->phi[0]));
-        const Vector d1 = delta(getPosition(myfrag->phi[2]), getPosition(myfrag->phi[1]));
-        const Vector d2 = delta(getPosition(myfrag->phi[3]), getPosition(myfrag->phi[2]));
-        Torsion t;
-        Vector dd0, dd1, dd2;
-        atom[s][a].t_phi = t.compute(d0,d1,d2,dd0,dd1,dd2);
-        atom[s][a].dd0[0]  = dd0;
-        atom[s][a].dd10[0] = dd1-dd0;
-        atom[s][a].dd21[0] = dd2-dd1;
-        atom[s][a].dd2[0]  = dd2;
-      }
-      if(myfrag->psi.size()==4) {
-        const Vector d0 = delta(getPosition(myfrag->psi[1]), getPosition(myfrag->psi[0]));
-        const Vector d1 = delta(getPosition(myfrag->psi[2]), getPosition(myfrag->psi[1]));
-        const Vector d2 = delta(getPosition(myfrag->psi[3]), getPosition(myfrag->psi[2]));
-        Torsion t;
-        Vector dd0, dd1, dd2;
-        atom[s][a].t_psi = t.compute(d0,d1,d2,dd0,dd1,dd2);
-        atom[s][a].dd0[1]  = dd0;
-        atom[s][a].dd10[1] = dd1-dd0;
-        atom[s][a].dd21[1] = dd2-dd1;
-        atom[s][a].dd2[1]  = dd2;
-      }
-      if(myfrag->chi1.size()==4) {
-        const Vector d0 = delta(getPosition(myfrag->chi1[1]), getPosition(myfrag->chi1[0]));
-        const Vector d1 = delta(getPosition(myfrag->chi1[2]), getPosition(myfrag->chi1[1]));
-        const Vector d2 = delta(getPosition(myfrag->chi1[3]), getPosition(myfrag->chi1[2]));
-        Torsion t;
-        Vector dd0, dd1, dd2;
-        atom[s][a].t_chi1 = t.compute(d0,d1,d2,dd0,dd1,dd2);
-        atom[s][a].dd0[2]  = dd0;
-        atom[s][a].dd10[2] = dd1-dd0;
-        atom[s][a].dd21[2] = dd2-dd1;
-        atom[s][a].dd2[2]  = dd2;
-      }
+  const unsigned nfrags = frags.size();
+  #pragma omp parallel for num_threads(OpenMP::getNumThreads())
+  for(unsigned f=0; f<nfrags; f++) {
+    const unsigned s = frags[f].first;
+    const unsigned a = frags[f].second;
+    const Fragment *myfrag = &atom[s][a];
+    if(myfrag->phi.size()==4) {
+      const Vector d0 = delta(getPosition(myfrag->phi[1]), getPosition(myfrag->phi[0]));
+      const Vector d1 = delta(getPosition(myfrag->phi[2]), getPosition(myfrag->phi[1]));
+      const Vector d2 = delta(getPosition(myfrag->phi[3]), getPosition(myfrag->phi[2]));
+      Torsion t;
+      Vector dd0, dd1, dd2;
+      atom[s][a].t_phi = t.compute(d0,d1,d2,dd0,dd1,dd2);
+      atom[s][a].dd0[0]  = dd0;
+      atom[s][a].dd10[0] = dd1-dd0;
+      atom[s][a].dd21[0] = dd2-dd1;
+      atom[s][a].dd2[0]  = dd2;
+    }
+    if(myfrag->psi.size()==4) {
+      const Vector d0 = delta(getPosition(myfrag->psi[1]), getPosition(myfrag->psi[0]));
+      const Vector d1 = delta(getPosition(myfrag->psi[2]), getPosition(myfrag->psi[1]));
+      const Vector d2 = delta(getPosition(myfrag->psi[3]), getPosition(myfrag->psi[2]));
+      Torsion t;
+      Vector dd0, dd1, dd2;
+      atom[s][a].t_psi = t.compute(d0,d1,d2,dd0,dd1,dd2);
+      atom[s][a].dd0[1]  = dd0;
+      atom[s][a].dd10[1] = dd1-dd0;
+      atom[s][a].dd21[1] = dd2-dd1;
+      atom[s][a].dd2[1]  = dd2;
+    }
+    if(myfrag->chi1.size()==4) {
+      const Vector d0 = delta(getPosition(myfrag->chi1[1]), getPosition(myfrag->chi1[0]));
+      const Vector d1 = delta(getPosition(myfrag->chi1[2]), getPosition(myfrag->chi1[1]));
+      const Vector d2 = delta(getPosition(myfrag->chi1[3]), getPosition(myfrag->chi1[2]));
+      Torsion t;
+      Vector dd0, dd1, dd2;
+      atom[s][a].t_chi1 = t.compute(d0,d1,d2,dd0,dd1,dd2);
+      atom[s][a].dd0[2]  = dd0;
+      atom[s][a].dd10[2] = dd1-dd0;
+      atom[s][a].dd21[2] = dd2-dd1;
+      atom[s][a].dd2[2]  = dd2;
     }
   }
 }
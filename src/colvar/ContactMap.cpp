@@ -282,16 +282,18 @@ void ContactMap::calculate() {
     rank=comm.Get_rank();
   }
 
-// sum over close pairs
+// compute the distances of all the pairs of this rank at once
+  std::vector<Vector> distances;
   for(unsigned i=rank; i<nl->size(); i+=stride) {
-    Vector distance;
+    distances.push_back(delta(getPosition(nl->getClosePair(i).first),getPosition(nl->getClosePair(i).second)));
+  }
+  if(pbc) pbcApply(distances,distances.size());
+
+// sum over close pairs
+  for(unsigned i=rank, k=0; i<nl->size(); i+=stride, ++k) {
+    const Vector & distance(distances[k]);
     unsigned i0=nl->getClosePair(i).first;
     unsigned i1=nl->getClosePair(i).second;
-    if(pbc) {
-      distance=pbcDistance(getPosition(i0),getPosition(i1));
-    } else {
-      distance=delta(getPosition(i0),getPosition(i1));
-    }
 
     double dfunc=0.;
     double coord = weight[i]*(sfs[i].calculate(distance.modulo(), dfunc) - reference[i]);
@@ -50,6 +50,10 @@ but it can be changed using the optional SWITCH option.
 
 To make your calculation faster you can use a neighbor list, which makes it that only a
 relevant subset of the pairwise distance are calculated at every step.
+The neighbor list can be updated with a fixed frequency (NL_STRIDE) or, using NL_SKIN,
+it can be built with a larger cutoff and updated automatically only when
+some atom has moved by more than half of the skin. The latter choice guarantees that no
+pair closer than NL_CUTOFF is missed and it is also compatible with replica exchange.
 
 If GROUPB is empty, it will sum the \f$\frac{N(N-1)}{2}\f$ pairs in GROUPA. This avoids computing
 twice permuted indexes (e.g. pair (i,j) and (j,i)) thus running at twice the speed.
@@ -66,6 +70,13 @@ The following example instructs plumed to calculate the total coordination numbe
 COORDINATION GROUPA=1-10 GROUPB=20-100 R_0=0.3 NLIST NL_CUTOFF=0.5 NL_STRIDE=100
 \endplumedfile
 
+The same calculation can be done with a neighbour list that is updated only when needed.
+Here pairs closer than 0.6 nm are stored and the list is rebuilt as soon as an atom
+has moved by more than 0.05 nm from its position at the last update.
+\plumedfile
+COORDINATION GROUPA=1-10 GROUPB=20-100 R_0=0.3 NLIST NL_CUTOFF=0.5 NL_SKIN=0.1
+\endplumedfile
+
 The following is a dummy example which should compute the value 0 because the self interaction
 of atom 1 is skipped. Notice that in plumed 2.0 "self interactions" were not skipped, and the
 same calculation should return 1.
@@ -104,6 +115,8 @@ public:
 // active methods:
   static void registerKeywords( Keywords& keys );
   virtual double pairing(double distance,double&dfunc,unsigned i,unsigned j)const;
+  virtual void pairingBlock(const std::vector<double>& distance,std::vector<double>& value,std::vector<double>& dfunc,
+                            const std::vector<unsigned>& i,const std::vector<unsigned>& j)const;
 };
 
 PLUMED_REGISTER_ACTION(Coordination,"COORDINATION")
@@ -153,6 +166,13 @@ double Coordination::pairing(double distance,double&dfunc,unsigned i,unsigned j)
   return switchingFunction.calculateSqr(distance,dfunc);
 }
 
+void Coordination::pairingBlock(const std::vector<double>& distance,std::vector<double>& value,std::vector<double>& dfunc,
+                                const std::vector<unsigned>& i,const std::vector<unsigned>& j)const {
+  (void) i; // avoid warnings
+  (void) j; // avoid warnings
+  switchingFunction.calculateSqr(distance,value,dfunc);
+}
+
 }
 
 }
@@ -38,6 +38,7 @@ void CoordinationBase::registerKeywords( Keywords& keys ) {
   keys.addFlag("NLIST",false,"Use a neighbour list to speed up the calculation");
   keys.add("optional","NL_CUTOFF","The cutoff for the neighbour list");
   keys.add("optional","NL_STRIDE","The frequency with which we are updating the atoms in the neighbour list");
+  keys.add("optional","NL_SKIN","Build the neighbour list with cutoff NL_CUTOFF+NL_SKIN and update it only when some atom moved more than half of NL_SKIN. Cannot be used together with NL_STRIDE");
   keys.add("atoms","GROUPA","First list of atoms");
   keys.add("atoms","GROUPB","Second list of atoms (if empty, N*(N-1)/2 pairs in GROUPA are counted)");
 }
@@ -67,13 +68,17 @@ CoordinationBase::CoordinationBase(const ActionOptions&ao):
 // neighbor list stuff
   bool doneigh=false;
   double nl_cut=0.0;
+  double nl_skin=0.0;
   int nl_st=0;
   parseFlag("NLIST",doneigh);
   if(doneigh) {
     parse("NL_CUTOFF",nl_cut);
     if(nl_cut<=0.0) error("NL_CUTOFF should be explicitly specified and positive");
+    parse("NL_SKIN",nl_skin);
     parse("NL_STRIDE",nl_st);
-    if(nl_st<=0) error("NL_STRIDE should be explicitly specified and positive");
+    if(nl_skin>0.0) {
+      if(nl_st>0) error("NL_STRIDE and NL_SKIN cannot be used together");
+    } else if(nl_st<=0) error("either NL_STRIDE or NL_SKIN should be explicitly specified and positive");
   }
 
   addValueWithDerivatives(); setNotPeriodic();
@@ -84,6 +89,7 @@ CoordinationBase::CoordinationBase(const ActionOptions&ao):
     if(doneigh)  nl= new NeighborList(ga_lista,pbc,getPbc(),nl_cut,nl_st);
     else         nl= new NeighborList(ga_lista,pbc,getPbc());
   }
+  if(nl_skin>0.0) nl->setSkin(nl_skin);
 
   requestAtoms(nl->getFullAtomList());
 
@@ -104,7 +110,8 @@ CoordinationBase::CoordinationBase(const ActionOptions&ao):
   if(dopair) log.printf("  with PAIR option\n");
   if(doneigh) {
     log.printf("  using neighbor lists with\n");
-    log.printf("  update every %d steps and cutoff %f\n",nl_st,nl_cut);
+    if(nl_skin>0.0) log.printf("  cutoff %f and skin %f, updated when an atom moves more than half the skin\n",nl_cut,nl_skin);
+    else log.printf("  update every %d steps and cutoff %f\n",nl_st,nl_cut);
   }
 }
 
@@ -128,6 +135,13 @@ void CoordinationBase::prepare() {
 }
 
 // calculator
+void CoordinationBase::pairingBlock(const std::vector<double>& distance,std::vector<double>& value,std::vector<double>& dfunc,
+                                    const std::vector<unsigned>& i,const std::vector<unsigned>& j)const {
+  value.resize(distance.size());
+  dfunc.resize(distance.size());
+  for(unsigned k=0; k<distance.size(); ++k) value[k]=pairing(distance[k],dfunc[k],i[k],j[k]);
+}
+
 void CoordinationBase::calculate()
 {
 
@@ -139,6 +153,11 @@ void CoordinationBase::calculate()
   if(nl->getStride()>0 && invalidateList) {
     nl->update(getPositions());
   }
+// with a skin all the atoms are always requested, so that the list
+// can be rebuilt as soon as an atom has moved too much
+  if(nl->getSkin()>0.0 && nl->isUpdateNeeded(getPositions())) {
+    nl->update(getPositions());
+  }
 
   unsigned stride=comm.Get_size();
   unsigned rank=comm.Get_rank();
@@ -161,42 +180,55 @@ void CoordinationBase::calculate()
   {
     std::vector<Vector> omp_deriv(getPositions().size());
     Tensor omp_virial;
+    double omp_ncoord=0.;
+// pairs are processed in blocks, so that the pairing function can be evaluated for many of them at once
+    const unsigned blocksize=64;
+    std::vector<unsigned> block_i0, block_i1;
+    std::vector<Vector> block_distance;
+    std::vector<double> block_d2, block_val, block_dfunc;
+    block_i0.reserve(blocksize); block_i1.reserve(blocksize);
+    block_distance.reserve(blocksize); block_d2.reserve(blocksize);
+
+    std::vector<Vector> & myderiv(nt>1?omp_deriv:deriv);
+    Tensor & myvirial(nt>1?omp_virial:virial);
+    auto flush=[&]() {
+// minimal image convention is applied to the whole block at once
+      if(pbc) pbcApply(block_distance,block_distance.size());
+      block_d2.resize(block_distance.size());
+      for(unsigned k=0; k<block_distance.size(); ++k) block_d2[k]=block_distance[k].modulo2();
+      pairingBlock(block_d2,block_val,block_dfunc,block_i0,block_i1);
+      for(unsigned k=0; k<block_i0.size(); ++k) {
+        omp_ncoord += block_val[k];
+        Vector dd(block_dfunc[k]*block_distance[k]);
+        Tensor vv(dd,block_distance[k]);
+        myderiv[block_i0[k]]-=dd;
+        myderiv[block_i1[k]]+=dd;
+        myvirial-=vv;
+      }
+      block_i0.clear(); block_i1.clear(); block_distance.clear();
+    };
 
-    #pragma omp for reduction(+:ncoord) nowait
+    #pragma omp for nowait
     for(unsigned int i=rank; i<nn; i+=stride) {
 
-      Vector distance;
       unsigned i0=nl->getClosePair(i).first;
       unsigned i1=nl->getClosePair(i).second;
 
       if(getAbsoluteIndex(i0)==getAbsoluteIndex(i1)) continue;
 
-      if(pbc) {
-        distance=pbcDistance(getPosition(i0),getPosition(i1));
-      } else {
-        distance=delta(getPosition(i0),getPosition(i1));
-      }
-
-      double dfunc=0.;
-      ncoord += pairing(distance.modulo2(), dfunc,i0,i1);
+      block_i0.push_back(i0); block_i1.push_back(i1);
+      block_distance.push_back(delta(getPosition(i0),getPosition(i1)));
+      if(block_i0.size()==blocksize) flush();
+    }
+    if(!block_i0.empty()) flush();
 
-      Vector dd(dfunc*distance);
-      Tensor vv(dd,distance);
+    #pragma omp critical
+    {
+      ncoord+=omp_ncoord;
       if(nt>1) {
-        omp_deriv[i0]-=dd;
-        omp_deriv[i1]+=dd;
-        omp_virial-=vv;
-      } else {
-        deriv[i0]-=dd;
-        deriv[i1]+=dd;
-        virial-=vv;
+        for(unsigned i=0; i<getPositions().size(); i++) deriv[i]+=omp_deriv[i];
+        virial+=omp_virial;
       }
-
-    }
-    #pragma omp critical
-    if(nt>1) {
-      for(int i=0; i<getPositions().size(); i++) deriv[i]+=omp_deriv[i];
-      virial+=omp_virial;
     }
   }
 
@@ -43,6 +43,11 @@ public:
   virtual void calculate();
   virtual void prepare();
   virtual double pairing(double distance,double&dfunc,unsigned i,unsigned j)const=0;
+/// Compute the pairing function for a block of pairs, given their squared distances.
+/// By default it calls pairing() for each of them, but it can be overridden
+/// when the function can be computed more efficiently for many pairs at once.
+  virtual void pairingBlock(const std::vector<double>& distance,std::vector<double>& value,std::vector<double>& dfunc,
+                            const std::vector<unsigned>& i,const std::vector<unsigned>& j)const;
   static void registerKeywords( Keywords& keys );
 };
 
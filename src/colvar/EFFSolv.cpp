@@ -28,6 +28,10 @@
 #include "core/PlumedMain.h"
 #include "core/SetupMolInfo.h"
 #include "tools/OpenMP.h"
+#include "tools/LinkCells.h"
+#include "tools/Communicator.h"
+#include <algorithm>
+#include <cmath>
 #include <initializer_list>
 
 #define INV_PI_SQRT_PI 0.179587122
@@ -84,9 +88,13 @@ private:
   double delta_g_ref;
   unsigned stride;
   unsigned nl_update;
-  vector<vector<unsigned> > nl;
-  vector<vector<bool> > nlexpo;
+/// neighbours of atom i are nl[nl_start[i]] ... nl[nl_start[i+1]-1], all with index larger than i
+  vector<unsigned> nl_start;
+  vector<unsigned> nl;
   vector<vector<double> > parameter;
+/// derivatives and virial accumulated by each thread
+  vector<vector<Vector> > deriv_omp;
+  vector<Tensor> deriv_box_omp;
   void setupConstants(const vector<AtomNumber> &atoms, vector<vector<double> > &parameter, bool tcorr);
   map<string, map<string, string> > setupTypeMap();
   map<string, vector<double> > setupValueMap();
@@ -135,8 +143,7 @@ EFFSolv::EFFSolv(const ActionOptions&ao):
   log << "  Bibliography " << plumed.cite("Lazaridis T, Karplus M, Proteins Struct. Funct. Genet. 35, 133 (1999)"); log << "\n";
 
 
-  nl.resize(size);
-  nlexpo.resize(size);
+  nl_start.resize(size+1,0);
   parameter.resize(size, vector<double>(4, 0));
   setupConstants(atoms, parameter, tcorr);
 
@@ -148,29 +155,76 @@ EFFSolv::EFFSolv(const ActionOptions&ao):
 void EFFSolv::update_neighb() {
   const double lower_c2 = 0.24 * 0.24; // this is the cut-off for bonded atoms
   const unsigned size = getNumberOfAtoms();
-  for (unsigned i=0; i<size; ++i) {
-    nl[i].clear();
-    nlexpo[i].clear();
-    const Vector posi = getPosition(i);
-    // Loop through neighboring atoms, add the ones below cutoff
-    for (unsigned j=i+1; j<size; ++j) {
-      const double d2 = delta(posi, getPosition(j)).modulo2();
-      if (d2 < lower_c2 && j < i+14) {
-        // crude approximation for i-i+1/2 interactions,
-        // we want to exclude atoms separated by less than three bonds
-        continue;
-      }
-      // We choose the maximum lambda value and use a more conservative cutoff
-      double mlambda = 1./parameter[i][2];
-      if (1./parameter[j][2] > mlambda) mlambda = 1./parameter[j][2];
-      const double c2 = (4. * mlambda + buffer) * (4. * mlambda + buffer);
-      if (d2 < c2 ) {
-        nl[i].push_back(j);
-        if(parameter[i][2] == parameter[j][2] && parameter[i][3] == parameter[j][3]) {
-          nlexpo[i].push_back(true);
-        } else nlexpo[i].push_back(false);
-      }
+
+  // The cutoff depends on the pair of atoms, cells are as large as the largest one
+  double max_lambda = 0.;
+  for (unsigned i=0; i<size; ++i) max_lambda = std::max(max_lambda, 1./parameter[i][2]);
+  const double max_c = 4. * max_lambda + buffer;
+
+  // Atoms are binned in cells enclosing all of them, as distances are calculated without pbc
+  Vector lower = getPosition(0);
+  Vector upper = getPosition(0);
+  for (unsigned i=1; i<size; ++i) for (unsigned k=0; k<3; ++k) {
+      lower[k] = std::min(lower[k], getPosition(i)[k]);
+      upper[k] = std::max(upper[k], getPosition(i)[k]);
     }
+  Tensor box;
+  for (unsigned k=0; k<3; ++k) box(k,k) = upper[k] - lower[k] + max_c;
+  Pbc cellpbc;
+  cellpbc.setBox(box);
+  // cells are made larger than the cutoff when they would be more than the atoms
+  double cellsize = std::cbrt(box.determinant()/size);
+  if (cellsize < max_c) cellsize = max_c;
+
+  Communicator serial;
+  LinkCells cells(serial);
+  cells.setCutoff(cellsize);
+  vector<unsigned> indices(size);
+  for (unsigned i=0; i<size; ++i) indices[i] = i;
+  cells.buildCellLists(getPositions(), indices, cellpbc);
+
+  // Atoms are distributed among threads in contiguous blocks, so that
+  // the neighbours found by each thread can then be copied in a single array
+  nl_start.assign(size+1, 0);
+  #pragma omp parallel num_threads(OpenMP::getNumThreads())
+  {
+    vector<unsigned> cells_required;
+    vector<unsigned> candidates(size+1);
+    vector<unsigned> mynl;
+    unsigned myfirst = size;
+    #pragma omp for schedule(static)
+    for (unsigned i=0; i<size; ++i) {
+      if (myfirst == size) myfirst = i;
+      const unsigned begin = mynl.size();
+      const Vector posi = getPosition(i);
+      unsigned ncandidates = 1; candidates[0] = i;
+      cells.retrieveNeighboringAtoms(posi, cells_required, ncandidates, candidates);
+      // Loop through neighboring atoms, add the ones below cutoff
+      for (unsigned k=1; k<ncandidates; ++k) {
+        const unsigned j = candidates[k];
+        if (j < i) continue;
+        const double d2 = delta(posi, getPosition(j)).modulo2();
+        if (d2 < lower_c2 && j < i+14) {
+          // crude approximation for i-i+1/2 interactions,
+          // we want to exclude atoms separated by less than three bonds
+          continue;
+        }
+        // We choose the maximum lambda value and use a more conservative cutoff
+        double mlambda = 1./parameter[i][2];
+        if (1./parameter[j][2] > mlambda) mlambda = 1./parameter[j][2];
+        const double c2 = (4. * mlambda + buffer) * (4. * mlambda + buffer);
+        if (d2 < c2 ) mynl.push_back(j);
+      }
+      // neighbours are stored in increasing order
+      std::sort(mynl.begin()+begin, mynl.end());
+      nl_start[i+1] = mynl.size() - begin;
+    }
+    #pragma omp single
+    {
+      for (unsigned i=0; i<size; ++i) nl_start[i+1] += nl_start[i];
+      nl.resize(nl_start[size]);
+    }
+    if (myfirst < size) std::copy(mynl.begin(), mynl.end(), nl.begin() + nl_start[myfirst]);
   }
 }
 
@@ -185,12 +239,24 @@ void EFFSolv::calculate() {
   double bias = 0.0;
   Tensor deriv_box;
   unsigned nt=OpenMP::getNumThreads();
-  const unsigned nn=nl.size();
+  const unsigned nn=size;
   if(nt*10>nn) nt=nn/10;
   if(nt==0)nt=1;
+  if(deriv_omp.size()<nt) {
+    deriv_omp.resize(nt);
+    deriv_box_omp.resize(nt);
+  }
   #pragma omp parallel num_threads(nt)
   {
-    vector<Vector> deriv_omp(size);
+    const unsigned mythread=OpenMP::getThreadNum();
+    // all the nt buffers are zeroed, since the runtime can start fewer threads than requested
+    // and the buffers of the missing ones are still summed below
+    #pragma omp for
+    for(unsigned t=0; t<nt; t++) {
+      deriv_omp[t].assign(size, Vector(0,0,0));
+      deriv_box_omp[t].zero();
+    }
+    vector<Vector> & myderiv=deriv_omp[mythread];
     #pragma omp for reduction(+:bias)
     for (unsigned i=0; i<size; ++i) {
       const Vector posi = getPosition(i);
@@ -202,8 +268,8 @@ void EFFSolv::calculate() {
       const double vdw_radius_i   = parameter[i][3];
 
       // The pairwise interactions are unsymmetric, but we can get away with calculating the distance only once
-      for (unsigned i_nl=0; i_nl<nl[i].size(); ++i_nl) {
-        const unsigned j = nl[i][i_nl];
+      for (unsigned i_nl=nl_start[i]; i_nl<nl_start[i+1]; ++i_nl) {
+        const unsigned j = nl[i_nl];
         const double vdw_volume_j   = parameter[j][0];
         const double delta_g_free_j = parameter[j][1];
         const double inv_lambda_j   = parameter[j][2];
@@ -218,7 +284,7 @@ void EFFSolv::calculate() {
         double deriv = 0.;
 
         // in this case we can calculate a single exponential
-        if(!nlexpo[i][i_nl]) {
+        if(inv_lambda_i != inv_lambda_j || vdw_radius_i != vdw_radius_j) {
           // i-j interaction
           if(inv_rij > 0.25*inv_lambda_i)
           {
@@ -254,18 +320,24 @@ void EFFSolv::calculate() {
         }
 
         const Vector dd = deriv*dist;
-        deriv_i      += dd;
-        deriv_omp[j] -= dd;
+        deriv_i     += dd;
+        myderiv[j]  -= dd;
       }
-      deriv_omp[i] += deriv_i;
+      myderiv[i] += deriv_i;
       bias += - 0.5 * fedensity;
     }
-    #pragma omp critical
+    // each thread sums the contributions of all the threads to a block of atoms
+    Tensor mybox;
+    #pragma omp for
     for(unsigned i=0; i<size; i++) {
-      setAtomsDerivatives(i, -deriv_omp[i]);
-      deriv_box += Tensor(getPosition(i), -deriv_omp[i]);
+      Vector deriv_i=deriv_omp[0][i];
+      for(unsigned t=1; t<nt; t++) deriv_i += deriv_omp[t][i];
+      setAtomsDerivatives(i, -deriv_i);
+      mybox += Tensor(getPosition(i), -deriv_i);
     }
+    deriv_box_omp[mythread]=mybox;
   }
+  for(unsigned t=0; t<nt; t++) deriv_box += deriv_box_omp[t];
 
   setBoxDerivatives(-deriv_box);
   setValue(delta_g_ref + bias);
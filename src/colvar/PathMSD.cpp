@@ -53,6 +53,18 @@ timesteps and consider only the closest 8 member to the actual md snapshots.
 
 In the REFERENCE PDB file the frames must be separated either using END or ENDMDL.
 
+Frames that are far from the current configuration have exponentially small weights, but the
+calculation of their derivatives has the same cost as for the others.
+With WEIGHT_THRESHOLD the derivatives are only calculated for the frames with a normalized weight
+larger than the threshold. The value of the variables is not affected, and at the end of the
+simulation an upper bound to the error on the norm of the derivatives is written in the log.
+Differently from the neighbor list, this is compatible with replica exchange.
+
+\plumedfile
+p1: PATHMSD REFERENCE=file.pdb  LAMBDA=500.0 WEIGHT_THRESHOLD=1e-6
+PRINT ARG=p1.sss,p1.zzz STRIDE=1 FILE=colvar FMT=%8.4f
+\endplumedfile
+
 \note
 The implementation of this collective variable and of \ref PROPERTYMAP
 is shared, as well as most input options.
@@ -28,6 +28,7 @@
 #include "tools/RMSD.h"
 #include "tools/Tools.h"
 #include <cmath>
+#include <algorithm>
 
 using namespace std;
 
@@ -41,17 +42,25 @@ void PathMSDBase::registerKeywords(Keywords& keys) {
   keys.add("compulsory","REFERENCE","the pdb is needed to provide the various milestones");
   keys.add("optional","NEIGH_SIZE","size of the neighbor list");
   keys.add("optional","NEIGH_STRIDE","how often the neighbor list needs to be calculated in time units");
+  keys.add("compulsory","WEIGHT_THRESHOLD","0.0","the derivatives of the distance from frames with a normalized weight smaller than this value are neglected");
 }
 
 PathMSDBase::PathMSDBase(const ActionOptions&ao):
   PLUMED_COLVAR_INIT(ao),
   neigh_size(-1),
   neigh_stride(-1),
+  weight_threshold(0.0),
+  nsteps(0),
+  nderivs(0),
+  nderivs_skipped(0),
+  maxerror_z(0.0),
   nframes(0)
 {
   parse("LAMBDA",lambda);
   parse("NEIGH_SIZE",neigh_size);
   parse("NEIGH_STRIDE",neigh_stride);
+  parse("WEIGHT_THRESHOLD",weight_threshold);
+  if(weight_threshold<0.0 || weight_threshold>=1.0) error("WEIGHT_THRESHOLD should be between 0 and 1");
   parse("REFERENCE",reference);
 
   // open the file
@@ -75,10 +84,9 @@ PathMSDBase::PathMSDBase(const ActionOptions&ao):
         log<<"Found PDB: "<<nframes<<" containing  "<<mypdb.getAtomNumbers().size()<<" atoms\n";
         pdbv.push_back(mypdb);
 //            requestAtoms(mypdb.getAtomNumbers()); // is done in non base classes
-        derivs_s.resize(mypdb.getAtomNumbers().size());
         derivs_z.resize(mypdb.getAtomNumbers().size());
         mymsd.set(mypdb,"OPTIMAL");
-        msdv.push_back(mymsd); // the vector that stores the frames
+        msdv.add(mymsd); // the object that stores the frames
         //log<<mypdb;
       } else {break ;}
     }
@@ -97,7 +105,21 @@ PathMSDBase::PathMSDBase(const ActionOptions&ao):
   } else {
     log.printf("  Neighbor list NOT enabled \n");
   }
+  if(weight_threshold>0.0) {
+    log.printf("  Derivatives neglected for frames with normalized weight smaller than %g\n",weight_threshold);
+    log.printf("  An upper bound to the error on the derivatives will be reported at the end of the simulation\n");
+  }
+
+}
 
+PathMSDBase::~PathMSDBase() {
+  if(weight_threshold>0.0 && nsteps>0) {
+    log.printf("  Action %s: derivatives calculated for %g frames per step out of %g\n",getLabel().c_str(),
+               double(nderivs-nderivs_skipped)/nsteps,double(nderivs)/nsteps);
+    for(unsigned j=0; j<maxerror_s.size(); j++)
+      log.printf("  Action %s: largest upper bound to the error on the norm of the derivatives of component %u of the path: %g\n",getLabel().c_str(),j,maxerror_s[j]);
+    log.printf("  Action %s: largest upper bound to the error on the norm of the derivatives of the distance from the path: %g\n",getLabel().c_str(),maxerror_z);
+  }
 }
 
 void PathMSDBase::calculate() {
@@ -125,25 +147,18 @@ void PathMSDBase::calculate() {
   plumed_assert(imgVec.size()>0);
 
   std::vector<double> tmp_distances(imgVec.size(),0.0);
-  std::vector<Vector> tmp_derivs;
-// this array is a merge of all tmp_derivs, so as to allow a single comm.Sum below
-  std::vector<Vector> tmp_derivs2(imgVec.size()*nat);
+// frames calculated by this process
+  std::vector<unsigned> myframes;
+  std::vector<double> mydistances;
+  for(unsigned i=rank; i<imgVec.size(); i+=stride) myframes.push_back(imgVec[i].index);
 
 // if imgVec.size() is less than nframes, it means that only some msd will be calculated
-  for(unsigned i=rank; i<imgVec.size(); i+=stride) {
-// store temporary local results
-    tmp_distances[i]=msdv[imgVec[i].index].calculate(getPositions(),tmp_derivs,true);
-    plumed_assert(tmp_derivs.size()==nat);
-    for(unsigned j=0; j<nat; j++) tmp_derivs2[i*nat+j]=tmp_derivs[j];
-  }
+  msdv.calculate(getPositions(),myframes,mydistances,true);
+  for(unsigned k=0; k<myframes.size(); k++) tmp_distances[rank+k*stride]=mydistances[k];
 // reduce over all processors
   comm.Sum(tmp_distances);
-  comm.Sum(tmp_derivs2);
-// assign imgVec[i].distance and imgVec[i].distder
-  for(unsigned i=0; i<imgVec.size(); i++) {
-    imgVec[i].distance=tmp_distances[i];
-    imgVec[i].distder.assign(&tmp_derivs2[i*nat],nat+&tmp_derivs2[i*nat]);
-  }
+// assign imgVec[i].distance
+  for(unsigned i=0; i<imgVec.size(); i++) imgVec[i].distance=tmp_distances[i];
 
 // END OF THE HEAVY PART
 
@@ -159,9 +174,6 @@ void PathMSDBase::calculate() {
   double partition=0.;
   double tmp;
 
-  // clean vector
-  for(unsigned i=0; i< derivs_z.size(); i++) {derivs_z[i].zero();}
-
   for(auto & it : imgVec) {
     it.similarity=exp(-lambda*(it.distance));
     //log<<"DISTANCE "<<(*it).distance<<"\n";
@@ -172,18 +184,50 @@ void PathMSDBase::calculate() {
   }
   for(unsigned i=0; i<s_path.size(); i++) { s_path[i]/=partition;  val_s_path[i]->set(s_path[i]) ;}
   val_z_path->set(-(1./lambda)*std::log(partition));
-  for(unsigned j=0; j<s_path.size(); j++) {
-    // clean up
-    for(unsigned i=0; i< derivs_s.size(); i++) {derivs_s[i].zero();}
-    // do the derivative
-    for(const auto & it : imgVec) {
-      double expval=it.similarity;
+
+  // clean vectors
+  derivs_s.resize(s_path.size());
+  for(unsigned j=0; j<s_path.size(); j++) derivs_s[j].assign(nat,Vector(0,0,0));
+  derivs_z.assign(nat,Vector(0,0,0));
+  // each process adds the derivatives of its own frames, skipping those with zero weight,
+  // so that only the derivatives of the path are communicated
+  const double min_similarity=weight_threshold*partition;
+  // bound to the error due to neglected frames for each component and for the distance
+  vector<double> error(s_path.size()+1,0.0);
+  unsigned nskipped=0;
+  for(unsigned k=0; k<myframes.size(); k++) {
+    const ImagePath & it(imgVec[rank+k*stride]);
+    const double expval=it.similarity;
+    if(expval==0.) continue;
+    if(expval<min_similarity && msdv.alignEqualsDisplace(it.index)) {
+      // the derivatives are not calculated, but their norm is bounded
+      const double bound=msdv.getDerivativeBound(it.index,it.distance)*expval/partition;
+      for(unsigned j=0; j<s_path.size(); j++) error[j]+=lambda*std::fabs(s_path[j]-it.property[j])*bound;
+      error[s_path.size()]+=bound;
+      nskipped++;
+      continue;
+    }
+    for(unsigned j=0; j<s_path.size(); j++) {
       tmp=lambda*expval*(s_path[j]-it.property[j])/partition;
-      for(unsigned i=0; i< derivs_s.size(); i++) { derivs_s[i]+=tmp*it.distder[i] ;}
-      if(j==0) {for(unsigned i=0; i< derivs_z.size(); i++) { derivs_z[i]+=it.distder[i]*expval/partition;}}
+      msdv.addDerivatives(it.index,tmp,derivs_s[j]);
     }
-    for(unsigned i=0; i< derivs_s.size(); i++) {
-      setAtomsDerivatives (val_s_path[j],i,derivs_s[i]);
+    msdv.addDerivatives(it.index,expval/partition,derivs_z);
+  }
+  for(unsigned j=0; j<s_path.size(); j++) comm.Sum(derivs_s[j]);
+  comm.Sum(derivs_z);
+  if(weight_threshold>0.0) {
+    comm.Sum(error);
+    comm.Sum(nskipped);
+    nsteps++;
+    nderivs+=imgVec.size();
+    nderivs_skipped+=nskipped;
+    maxerror_s.resize(s_path.size(),0.0);
+    for(unsigned j=0; j<s_path.size(); j++) maxerror_s[j]=std::max(maxerror_s[j],error[j]);
+    maxerror_z=std::max(maxerror_z,error[s_path.size()]);
+  }
+  for(unsigned j=0; j<s_path.size(); j++) {
+    for(unsigned i=0; i< nat; i++) {
+      setAtomsDerivatives (val_s_path[j],i,derivs_s[j][i]);
       if(j==0) {setAtomsDerivatives (val_z_path,i,derivs_z[i]);}
     }
   }
@@ -27,6 +27,7 @@
 
 #include "tools/PDB.h"
 #include "tools/RMSD.h"
+#include "tools/BatchRMSD.h"
 #include "tools/Tools.h"
 
 namespace PLMD {
@@ -44,8 +45,6 @@ class PathMSDBase : public Colvar {
     double distance;
     // similarity (exp - lambda distance) or other
     double similarity;
-    // derivatives of the distance
-    std::vector<Vector> distder;
     // here one can add a pointer to a value (hypothetically providing a distance from a point)
   };
   struct imgOrderByDist {
@@ -62,9 +61,17 @@ class PathMSDBase : public Colvar {
   double lambda;
   int neigh_size;
   int neigh_stride;
-  std::vector<RMSD> msdv;
+/// frames with a normalized weight smaller than this do not contribute to the derivatives
+  double weight_threshold;
+/// statistics on the frames excluded from the derivatives
+  unsigned long nsteps;
+  unsigned long nderivs;
+  unsigned long nderivs_skipped;
+  std::vector<double> maxerror_s;
+  double maxerror_z;
+  BatchRMSD msdv;
   std::string reference;
-  std::vector<Vector> derivs_s;
+  std::vector<std::vector<Vector> > derivs_s;
   std::vector<Vector> derivs_z;
   std::vector <ImagePath> imgVec; // this can be used for doing neighlist
 protected:
@@ -74,6 +81,7 @@ protected:
   unsigned nframes;
 public:
   explicit PathMSDBase(const ActionOptions&);
+  ~PathMSDBase();
 // active methods:
   virtual void calculate();
 //  virtual void prepare();
@@ -40,6 +40,7 @@
 #include "tools/OpenMP.h"
 #include "tools/Tools.h"
 #include "tools/Stopwatch.h"
+#include "StepProfile.h"
 #include <cstdlib>
 #include <cstring>
 #include <set>
@@ -83,7 +84,8 @@ PlumedMain::PlumedMain():
   stopFlag(NULL),
   stopNow(false),
   novirial(false),
-  detailedTimers(false)
+  detailedTimers(false),
+  stepProfile(NULL)
 {
   log.link(comm);
   log.setLinePrefix("PLUMED: ");
@@ -573,6 +575,9 @@ void PlumedMain::prepareCalc() {
 void PlumedMain::prepareDependencies() {
 
   stopwatch.start("1 Prepare dependencies");
+// the previous step is complete, store its timings
+  if(stepProfile) stepProfile->commitStep();
+  const double profileStart=(stepProfile?StepProfile::now():0.0);
 
 // activate all the actions which are on step
 // activation is recursive and enables also the dependencies
@@ -601,6 +606,7 @@ void PlumedMain::prepareDependencies() {
     }
   }
 
+  if(stepProfile) stepProfile->add(StepProfile::prepare,0,StepProfile::now()-profileStart);
   stopwatch.stop("1 Prepare dependencies");
 }
 
@@ -608,7 +614,9 @@ void PlumedMain::shareData() {
 // atom positions are shared (but only if there is something to do)
   if(!active)return;
   stopwatch.start("2 Sharing data");
+  const double profileStart=(stepProfile?StepProfile::now():0.0);
   if(atoms.getNatoms()>0) atoms.share();
+  if(stepProfile) stepProfile->add(StepProfile::share,0,StepProfile::now()-profileStart);
   stopwatch.stop("2 Sharing data");
 }
 
@@ -628,13 +636,16 @@ void PlumedMain::performCalc() {
 void PlumedMain::waitData() {
   if(!active)return;
   stopwatch.start("3 Waiting for data");
+  const double profileStart=(stepProfile?StepProfile::now():0.0);
   if(atoms.getNatoms()>0) atoms.wait();
+  if(stepProfile) stepProfile->add(StepProfile::wait,0,StepProfile::now()-profileStart);
   stopwatch.stop("3 Waiting for data");
 }
 
 void PlumedMain::justCalculate() {
   if(!active)return;
   stopwatch.start("4 Calculating (forward loop)");
+  const double profileStart=(stepProfile?StepProfile::now():0.0);
   bias=0.0;
   work=0.0;
 
@@ -649,6 +660,7 @@ void PlumedMain::justCalculate() {
         actionNumberLabel="4A "+actionNumberLabel+" "+p->getLabel();
         stopwatch.start(actionNumberLabel);
       }
+      const double actionStart=(stepProfile?StepProfile::now():0.0);
       ActionWithValue*av=dynamic_cast<ActionWithValue*>(p);
       ActionAtomistic*aa=dynamic_cast<ActionAtomistic*>(p);
       {
@@ -667,10 +679,12 @@ void PlumedMain::justCalculate() {
       if(av)av->setGradientsIfNeeded();
       ActionWithVirtualAtom*avv=dynamic_cast<ActionWithVirtualAtom*>(p);
       if(avv)avv->setGradientsIfNeeded();
+      if(stepProfile) stepProfile->add(StepProfile::calc,iaction+1,StepProfile::now()-actionStart);
       if(detailedTimers) stopwatch.stop(actionNumberLabel);
     }
     iaction++;
   }
+  if(stepProfile) stepProfile->add(StepProfile::calc,0,StepProfile::now()-profileStart);
   stopwatch.stop("4 Calculating (forward loop)");
 }
 
@@ -683,6 +697,7 @@ void PlumedMain::backwardPropagate() {
   if(!active)return;
   int iaction=0;
   stopwatch.start("5 Applying (backward loop)");
+  const double profileStart=(stepProfile?StepProfile::now():0.0);
 // apply them in reverse order
   for(auto pp=actionSet.rbegin(); pp!=actionSet.rend(); ++pp) {
     const auto & p(pp->get());
@@ -694,12 +709,15 @@ void PlumedMain::backwardPropagate() {
         actionNumberLabel="5A "+actionNumberLabel+" "+p->getLabel();
         stopwatch.start(actionNumberLabel);
       }
+      const double actionStart=(stepProfile?StepProfile::now():0.0);
 
       p->apply();
       ActionAtomistic*a=dynamic_cast<ActionAtomistic*>(p);
 // still ActionAtomistic has a special treatment, since they may need to add forces on atoms
       if(a) a->applyForces();
 
+// slots are numbered as in the forward loop
+      if(stepProfile) stepProfile->add(StepProfile::apply,actionSet.size()-iaction,StepProfile::now()-actionStart);
       if(detailedTimers) stopwatch.stop(actionNumberLabel);
     }
     iaction++;
@@ -709,6 +727,7 @@ void PlumedMain::backwardPropagate() {
   if(detailedTimers) stopwatch.start("5B Update forces");
   if(atoms.getNatoms()>0) atoms.updateForces();
   if(detailedTimers) stopwatch.stop("5B Update forces");
+  if(stepProfile) stepProfile->add(StepProfile::apply,0,StepProfile::now()-profileStart);
   stopwatch.stop("5 Applying (backward loop)");
 }
 
@@ -716,11 +735,18 @@ void PlumedMain::update() {
   if(!active)return;
 
   stopwatch.start("6 Update");
+  const double profileStart=(stepProfile?StepProfile::now():0.0);
 // update step (for statistics, etc)
   updateFlags.push(true);
+  unsigned iaction=0;
   for(const auto & p : actionSet) {
     p->beforeUpdate();
-    if(p->isActive() && p->checkUpdate() && updateFlagsTop()) p->update();
+    if(p->isActive() && p->checkUpdate() && updateFlagsTop()) {
+      const double actionStart=(stepProfile?StepProfile::now():0.0);
+      p->update();
+      if(stepProfile) stepProfile->add(StepProfile::update,iaction+1,StepProfile::now()-actionStart);
+    }
+    iaction++;
   }
   while(!updateFlags.empty()) updateFlags.pop();
   if(!updateFlags.empty()) plumed_merror("non matching changes in the update flags");
@@ -738,6 +764,7 @@ void PlumedMain::update() {
     log.flush();
     for(const auto & p : actionSet) p->fflush();
   }
+  if(stepProfile) stepProfile->add(StepProfile::update,0,StepProfile::now()-profileStart);
   stopwatch.stop("6 Update");
 }
 
@@ -60,6 +60,7 @@ class ActionSet;
 class DLLoader;
 class Communicator;
 class Stopwatch;
+class StepProfile;
 class Citations;
 class ExchangePatterns;
 class FileBase;
@@ -188,6 +189,9 @@ public:
 /// Flag to switch on detailed timers
   bool detailedTimers;
 
+/// Per-step timings of phases and actions, set by \ref PROFILE (NULL if not profiling)
+  StepProfile* stepProfile;
+
 /// Add a citation, returning a string containing the reference number, something like "[10]"
   std::string cite(const std::string&);
 
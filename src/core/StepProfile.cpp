@@ -0,0 +1,71 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "StepProfile.h"
+#include "tools/Exception.h"
+
+namespace PLMD {
+
+const char* StepProfile::getPhaseName(unsigned phase) {
+  static const char* names[nphases]= {"prepare","share","wait","calc","apply","update"};
+  plumed_assert(phase<nphases);
+  return names[phase];
+}
+
+StepProfile::StepProfile():
+  current(nphases),
+  touched(nphases),
+  samples(nphases),
+  nsteps(0)
+{
+}
+
+void StepProfile::add(unsigned phase, unsigned slot, double seconds) {
+  plumed_dbg_assert(phase<nphases);
+  if(slot>=current[phase].size()) {
+    current[phase].resize(slot+1,0.0);
+    touched[phase].resize(slot+1,false);
+  }
+  current[phase][slot]+=seconds;
+  touched[phase][slot]=true;
+}
+
+void StepProfile::commitStep() {
+  bool any=false;
+  for(unsigned i=0; i<nphases; ++i) {
+    if(samples[i].size()<current[i].size()) samples[i].resize(current[i].size());
+    for(unsigned j=0; j<current[i].size(); ++j) {
+      if(!touched[i][j]) continue;
+      samples[i][j].push_back(current[i][j]);
+      current[i][j]=0.0;
+      touched[i][j]=false;
+      any=true;
+    }
+  }
+  if(any) nsteps++;
+}
+
+void StepProfile::clear() {
+  for(auto & s : samples) for(auto & t : s) t.clear();
+  nsteps=0;
+}
+
+}
@@ -0,0 +1,77 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_core_StepProfile_h
+#define __PLUMED_core_StepProfile_h
+
+#include <chrono>
+#include <vector>
+
+namespace PLMD {
+
+/**
+\ingroup TOOLBOX
+Class collecting the time spent in each phase of a step and in each action.
+
+Contrary to Stopwatch, which only accumulates totals, this class keeps
+the time of every single step so that statistics (percentiles, load
+imbalance) can be computed on a window of steps. Each phase is split into
+slots: slot 0 is the whole phase and slot i+1 is the i-th action in the
+ActionSet. Times are accumulated in the current step with add() and
+moved to the window with commitStep().
+*/
+class StepProfile {
+public:
+/// Phases of a step, in the same order as in PlumedMain
+  enum Phase { prepare, share, wait, calc, apply, update, nphases };
+/// Name of a phase
+  static const char* getPhaseName(unsigned phase);
+/// Current time, in seconds
+  static double now() {
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+  }
+private:
+/// Time spent in the current step for each phase and slot
+  std::vector<std::vector<double> > current;
+/// Is the slot used in the current step
+  std::vector<std::vector<bool> > touched;
+/// Times of the committed steps for each phase and slot
+  std::vector<std::vector<std::vector<double> > > samples;
+/// Number of committed steps
+  unsigned nsteps;
+public:
+  StepProfile();
+/// Add a time to a slot of a phase in the current step
+  void add(unsigned phase, unsigned slot, double seconds);
+/// Store the times of the current step in the window
+  void commitStep();
+/// Discard all the committed steps
+  void clear();
+/// Number of committed steps in the window
+  unsigned getNumberOfSteps() const {return nsteps;}
+/// Number of slots of a phase
+  unsigned getNumberOfSlots(unsigned phase) const {return samples[phase].size();}
+/// Times of the committed steps for a slot of a phase
+  const std::vector<double> & getSamples(unsigned phase, unsigned slot) const {return samples[phase][slot];}
+};
+
+}
+#endif
@@ -0,0 +1,228 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "SphericalHarmonics.h"
+#include "multicolvar/MultiColvarBase.h"
+#include "multicolvar/AtomValuePack.h"
+#include "tools/SwitchingFunction.h"
+#include "core/ActionRegister.h"
+#include "core/PlumedMain.h"
+#include "tools/OpenMP.h"
+#include <algorithm>
+
+//+PLUMEDOC MCOLVAR STEINHARDT
+/*
+Calculate Steinhardt parameters of several orders at once.
+
+This action calculates the same quantities as \ref Q3, \ref Q4 and \ref Q6 (or any other order) for each of the
+atoms in the system, that is the norms
+
+\f[
+Q_l(i) = \sqrt{ \sum_{m=-l}^l q_{lm}(i)^{*} q_{lm}(i) } \qquad \textrm{with} \qquad
+q_{lm}(i) = \frac{\sum_j \sigma( r_{ij} ) Y_{lm}(\mathbf{r}_{ij}) }{\sum_j \sigma( r_{ij} ) }
+\f]
+
+for all the angular momenta \f$l\f$ listed with the L keyword.  Rather than running one separate action for every order,
+the list of neighbours of each atom is visited only once and the switching function is evaluated only once for each pair.
+The spherical harmonics of all the orders are then computed together, using recurrence relations for the derivatives of the
+Legendre polynomials and for the powers of \f$(x+iy)/r\f$.  Calculating \f$Q_4\f$ and \f$Q_6\f$ here thus costs little more than
+calculating \f$Q_6\f$ alone.
+
+Each order is exposed as a separate component of the quantities calculated for each atom: \f$Q_l\f$ is component \f$l\f$.
+The functions of the distribution of these quantities are thus selected using the COMPONENT keyword of MEAN, LESS_THAN,
+HISTOGRAM and so on, which must be one of the orders in L.  As COMPONENT is equal to one by default, it has to be given
+explicitly unless L contains 1.  The vectors \f$q_{lm}(i)\f$ are not stored for later use, so if you want
+to use \ref LOCAL_Q6 or \ref LOCAL_AVERAGE you should use \ref Q6 instead.
+
+\par Examples
+
+The following command calculates the average Q4 and Q6 parameters for the 64 atoms in a box of Lennard Jones and prints them
+to a file called colvar.  The result is the same as using \ref Q4 and \ref Q6 with the MEAN keyword.
+
+\plumedfile
+STEINHARDT SPECIES=1-64 D_0=1.3 R_0=0.2 L=4,6 MEAN1={COMPONENT=4} MEAN2={COMPONENT=6} LABEL=q
+PRINT ARG=q.mean-1,q.mean-2 FILE=colvar
+\endplumedfile
+
+*/
+//+ENDPLUMEDOC
+
+namespace PLMD {
+namespace crystallization {
+
+class MultiSteinhardt : public multicolvar::MultiColvarBase {
+private:
+  double rcut2;
+  SwitchingFunction switchingFunction;
+/// The angular momenta and the largest of them
+  std::vector<unsigned> orders;
+  unsigned lmax;
+/// Where the vector for each order starts in the list of quantities
+  std::vector<unsigned> start;
+/// Total number of components of all the vectors
+  unsigned ncomponents;
+/// The spherical harmonics (one for each OpenMP thread as they store the values for the current bond)
+  mutable std::vector<SphericalHarmonics> harmonics;
+public:
+  static void registerKeywords( Keywords& keys );
+  explicit MultiSteinhardt( const ActionOptions& ao );
+/// The norms are not periodic
+  bool isPeriodic() { return false; }
+/// The weight, the norms for l=1 to lmax and the real and imaginary parts of all the vectors
+  unsigned getNumberOfQuantities() const ;
+/// The norm of order l is component l
+  bool isComponentCalculated( const unsigned& icomp ) const ;
+  double compute( const unsigned& tindex, multicolvar::AtomValuePack& myatoms ) const ;
+};
+
+PLUMED_REGISTER_ACTION(MultiSteinhardt,"STEINHARDT")
+
+void MultiSteinhardt::registerKeywords( Keywords& keys ) {
+  MultiColvarBase::registerKeywords( keys );
+  keys.add("compulsory","L","the angular momenta of the Steinhardt parameters that should be calculated");
+  keys.add("compulsory","NN","12","The n parameter of the switching function ");
+  keys.add("compulsory","MM","0","The m parameter of the switching function; 0 implies 2*NN");
+  keys.add("compulsory","D_0","0.0","The d_0 parameter of the switching function");
+  keys.add("compulsory","R_0","The r_0 parameter of the switching function");
+  keys.add("optional","SWITCH","This keyword is used if you want to employ an alternative to the continuous swiching function defined above. "
+           "The following provides information on the \\ref switchingfunction that are available. "
+           "When this keyword is present you no longer need the NN, MM, D_0 and R_0 keywords.");
+  keys.use("SPECIES"); keys.use("SPECIESA"); keys.use("SPECIESB");
+  keys.use("MEAN"); keys.use("LESS_THAN"); keys.use("MORE_THAN"); keys.use("MAX"); keys.use("MIN");
+  keys.use("BETWEEN"); keys.use("HISTOGRAM"); keys.use("MOMENTS"); keys.use("ALT_MIN");
+  keys.use("LOWEST"); keys.use("HIGHEST");
+}
+
+MultiSteinhardt::MultiSteinhardt( const ActionOptions& ao ):
+  Action(ao),
+  MultiColvarBase(ao),
+  lmax(0),
+  ncomponents(0)
+{
+  parseVector("L",orders);
+  if( orders.size()==0 ) error("no angular momenta specified");
+  log.printf("  calculating Steinhardt parameters of order");
+  for(unsigned i=0; i<orders.size(); ++i) {
+    if( orders[i]==0 ) error("angular momenta should be larger than zero");
+    for(unsigned j=0; j<i; ++j) if( orders[j]==orders[i] ) error("angular momenta should be listed only once");
+    start.push_back( ncomponents ); ncomponents += 2*(2*orders[i]+1);
+    if( orders[i]>lmax ) lmax=orders[i];
+    log.printf(" %u", orders[i]);
+  }
+  log.printf("\n");
+
+  // Read in the switching function
+  std::string sw, errors; parse("SWITCH",sw);
+  if(sw.length()>0) {
+    switchingFunction.set(sw,errors);
+    if( errors.length()!=0 ) error("problem reading SWITCH keyword : " + errors );
+  } else {
+    double r_0=-1.0, d_0; int nn, mm;
+    parse("NN",nn); parse("MM",mm);
+    parse("R_0",r_0); parse("D_0",d_0);
+    if( r_0<0.0 ) error("you must set a value for R_0");
+    switchingFunction.set(nn,mm,r_0,d_0);
+  }
+  log.printf("  Steinhardt parameters of central atom and those within %s\n",( switchingFunction.description() ).c_str() );
+  log<<"  Bibliography "<<plumed.cite("Tribello, Giberti, Sosso, Salvalaglio and Parrinello, J. Chem. Theory Comput. 13, 1317 (2017)")<<"\n";
+  // Set the link cell cutoff
+  double rcut = switchingFunction.get_dmax();
+  setLinkCellCutoff( rcut ); rcut2 = rcut*rcut;
+  // The normalization of the spherical harmonics is computed once here
+  harmonics.assign( OpenMP::getNumThreads(), SphericalHarmonics( lmax ) );
+  std::vector<AtomNumber> all_atoms; setupMultiColvarBase( all_atoms ); checkRead();
+}
+
+unsigned MultiSteinhardt::getNumberOfQuantities() const {
+  return 1 + lmax + ncomponents;
+}
+
+bool MultiSteinhardt::isComponentCalculated( const unsigned& icomp ) const {
+  return std::find( orders.begin(), orders.end(), icomp )!=orders.end();
+}
+
+double MultiSteinhardt::compute( const unsigned& tindex, multicolvar::AtomValuePack& myatoms ) const {
+  double dfunc, sw, d2, dlen, tq, itq;
+  Vector myrealvec, myimagvec, real_dz, imag_dz;
+  plumed_dbg_assert( OpenMP::getThreadNum()<harmonics.size() );
+  SphericalHarmonics& sph=harmonics[OpenMP::getThreadNum()];
+  unsigned nord=orders.size(), vstart=1+lmax;
+
+  for(unsigned i=1; i<myatoms.getNumberOfAtoms(); ++i) {
+    Vector& distance=myatoms.getPosition(i);
+    if ( (d2=distance[0]*distance[0])<rcut2 &&
+         (d2+=distance[1]*distance[1])<rcut2 &&
+         (d2+=distance[2]*distance[2])<rcut2 &&
+         d2>epsilon ) {
+
+      dlen = sqrt(d2);
+      sw = switchingFunction.calculate( dlen, dfunc );
+      accumulateSymmetryFunction( -1, i, sw, (+dfunc)*distance, (-dfunc)*Tensor( distance,distance ), myatoms );
+      // Legendre polynomials and powers of (x+iy)/r for all the orders
+      sph.set( distance, dlen );
+
+      for(unsigned k=0; k<nord; ++k) {
+        unsigned l=orders[k], ncomp=2*l+1, base=vstart+start[k];
+        // Do stuff for m=0
+        sph.get( l, 0, tq, itq, real_dz, imag_dz );
+        myrealvec = (+sw)*real_dz + tq*(+dfunc)*distance;
+        accumulateSymmetryFunction( base + l, i, sw*tq, myrealvec, Tensor( -myrealvec,distance ), myatoms );
+        // Do stuff for all other m values
+        for(unsigned m=1; m<=l; ++m) {
+          sph.get( l, m, tq, itq, real_dz, imag_dz );
+          myrealvec = (+dfunc)*distance*tq + (+sw)*real_dz;
+          myimagvec = (+dfunc)*distance*itq + (+sw)*imag_dz;
+          accumulateSymmetryFunction( base+l+m, i, sw*tq, myrealvec, Tensor( -myrealvec,distance ), myatoms );
+          accumulateSymmetryFunction( base+ncomp+l+m, i, sw*itq, myimagvec, Tensor( -myimagvec,distance ), myatoms );
+          // -m part of vector is just +m part multiplied by (-1.0)**m and complex conjugated
+          double pref=(m%2==0) ? 1.0 : -1.0;
+          accumulateSymmetryFunction( base+l-m, i, pref*sw*tq, pref*myrealvec, pref*Tensor( -myrealvec,distance ), myatoms );
+          accumulateSymmetryFunction( base+ncomp+l-m, i, -pref*sw*itq, -pref*myimagvec, pref*Tensor( myimagvec,distance ), myatoms );
+        }
+      }
+    }
+  }
+
+  // Normalize
+  updateActiveAtoms( myatoms );
+  MultiValue& myvals=myatoms.getUnderlyingMultiValue();
+  for(unsigned i=0; i<ncomponents; ++i) myvals.quotientRule( vstart+i, vstart+i );
+
+  // And calculate the norm of the vector for each order
+  for(unsigned k=0; k<nord; ++k) {
+    unsigned base=vstart+start[k], ncomp=2*(2*orders[k]+1);
+    double norm=0;
+    for(unsigned i=0; i<ncomp; ++i) norm += myatoms.getValue(base+i)*myatoms.getValue(base+i);
+    norm=sqrt(norm); myatoms.setValue( orders[k], norm );
+    if( doNotCalculateDerivatives() || norm<epsilon ) continue;
+
+    double inorm = 1.0 / norm;
+    for(unsigned j=0; j<myvals.getNumberActive(); ++j) {
+      unsigned jder=myvals.getActiveIndex(j); double der=0;
+      for(unsigned i=0; i<ncomp; ++i) der += myatoms.getValue(base+i)*myvals.getDerivative( base+i, jder );
+      myvals.addDerivative( orders[k], jder, inorm*der );
+    }
+  }
+  return myatoms.getValue(1);
+}
+
+}
+}
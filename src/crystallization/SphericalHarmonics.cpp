@@ -0,0 +1,86 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "SphericalHarmonics.h"
+#include "tools/Tools.h"
+
+namespace PLMD {
+namespace crystallization {
+
+SphericalHarmonics::SphericalHarmonics( const unsigned& lm ):
+  lmax(lm),
+  normaliz(((lm+1)*(lm+2))/2),
+  dpoly(((lm+1)*(lm+2))/2),
+  powered(lm+1)
+{
+  // Spherical harmonics normalization:
+  // (-1)^m sqrt ( ((2l+1)*(l-m)!) / (4*pi*(l+m)!) )
+  for(unsigned l=0; l<=lmax; ++l) {
+    normaliz[index(l,0)] = sqrt( (2*l+1) / (4.0*pi) );
+    for(unsigned m=1; m<=l; ++m) normaliz[index(l,m)] = -normaliz[index(l,m-1)] / sqrt( static_cast<double>( (l+m)*(l-m+1) ) );
+  }
+}
+
+void SphericalHarmonics::set( const Vector& distance, const double& dlen ) {
+  double idlen=1.0/dlen, x=distance[2]*idlen;
+  // The m-th derivatives of the Legendre polynomials from:
+  // (l-m+1) P^(m)_{l+1} = (2l+1) x P^(m)_l - (l+m) P^(m)_{l-1} starting from P^(m)_m = (2m-1)!!
+  double dfact=1.0;
+  for(unsigned m=0; m<=lmax; ++m) {
+    if( m>0 ) dfact*=(2*m-1);
+    double pm1=0.0, pm=dfact; dpoly[index(m,m)]=pm;
+    for(unsigned l=m; l<lmax; ++l) {
+      double pp1=( (2*l+1)*x*pm - (l+m)*pm1 ) / (l-m+1);
+      dpoly[index(l+1,m)]=pp1; pm1=pm; pm=pp1;
+    }
+  }
+  // Derivatives of z/r wrt x, y, z
+  double idlen3=idlen*idlen*idlen;
+  dz = -( distance[2]*idlen3 )*distance; dz[2] += idlen;
+  // The complex number of which we have to take powers and its derivatives
+  std::complex<double> com1( distance[0]*idlen, distance[1]*idlen ), ii( 0.0, 1.0 );
+  dw_x = idlen - distance[0]*idlen*idlen*com1;
+  dw_y = ii*idlen - distance[1]*idlen*idlen*com1;
+  dw_z = -distance[2]*idlen*idlen*com1;
+  powered[0]=std::complex<double>(1.0,0.0);
+  for(unsigned m=1; m<=lmax; ++m) powered[m]=powered[m-1]*com1;
+}
+
+void SphericalHarmonics::get( const unsigned& l, const unsigned& m, double& re, double& im, Vector& dre, Vector& dim ) const {
+  plumed_dbg_assert( l<=lmax && m<=l );
+  double nn=normaliz[index(l,m)];
+  double poly_ass=nn*dpoly[index(l,m)], dpoly_ass=0.0;
+  if( m<l ) dpoly_ass=nn*dpoly[index(l,m+1)];
+  if( m==0 ) {
+    re=poly_ass; im=0.0; dre=dpoly_ass*dz; dim.zero(); return;
+  }
+  // Real and imaginary parts of ((x+iy)/r)^m
+  double real_z=real(powered[m]), imag_z=imag(powered[m]);
+  // Derivatives wrt ((x+iy)/r)^m
+  double md=static_cast<double>(m);
+  std::complex<double> dp_x=md*powered[m-1]*dw_x, dp_y=md*powered[m-1]*dw_y, dp_z=md*powered[m-1]*dw_z;
+  re=poly_ass*real_z; im=poly_ass*imag_z;
+  dre = dpoly_ass*real_z*dz + poly_ass*Vector( real(dp_x), real(dp_y), real(dp_z) );
+  dim = dpoly_ass*imag_z*dz + poly_ass*Vector( imag(dp_x), imag(dp_y), imag(dp_z) );
+}
+
+}
+}
@@ -0,0 +1,68 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_crystallization_SphericalHarmonics_h
+#define __PLUMED_crystallization_SphericalHarmonics_h
+
+#include "tools/Vector.h"
+#include <complex>
+#include <vector>
+
+namespace PLMD {
+namespace crystallization {
+
+/// Evaluates the spherical harmonics of the direction of a bond for all the orders
+/// up to lmax.  The m-th derivatives of the Legendre polynomials
+/// are computed with the three term recurrence in l and the powers of (x+iy)/r
+/// by repeated multiplication, so all the orders up to lmax are obtained at the
+/// cost of a single evaluation of the highest one.
+class SphericalHarmonics {
+private:
+/// The largest angular momentum
+  unsigned lmax;
+/// The normalization constants
+  std::vector<double> normaliz;
+/// The derivatives of the Legendre polynomials
+  std::vector<double> dpoly;
+/// The powers of (x+iy)/r
+  std::vector<std::complex<double> > powered;
+/// The derivatives of (x+iy)/r
+  std::complex<double> dw_x, dw_y, dw_z;
+/// The derivative of z/r
+  Vector dz;
+/// Get the position of l,m in the triangular tables
+  unsigned index( const unsigned& l, const unsigned& m ) const ;
+public:
+  explicit SphericalHarmonics( const unsigned& lmax );
+/// Compute everything for the bond vector distance with length dlen
+  void set( const Vector& distance, const double& dlen );
+/// Get the real and imaginary parts of Y_lm and their derivatives wrt the bond vector for m>=0
+  void get( const unsigned& l, const unsigned& m, double& re, double& im, Vector& dre, Vector& dim ) const ;
+};
+
+inline
+unsigned SphericalHarmonics::index( const unsigned& l, const unsigned& m ) const {
+  return (l*(l+1))/2 + m;
+}
+
+}
+}
+#endif
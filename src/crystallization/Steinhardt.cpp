@@ -21,7 +21,7 @@
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 #include "Steinhardt.h"
 #include "core/PlumedMain.h"
-#include <complex>
+#include "tools/OpenMP.h"
 
 namespace PLMD {
 namespace crystallization {
@@ -67,16 +67,17 @@ Steinhardt::Steinhardt( const ActionOptions& ao ):
 
 void Steinhardt::setAngularMomentum( const unsigned& ang ) {
   tmom=ang; setVectorDimensionality( 2*(2*ang + 1) );
+  harmonics.assign( OpenMP::getNumThreads(), SphericalHarmonics( tmom ) );
 }
 
 void Steinhardt::calculateVector( multicolvar::AtomValuePack& myatoms ) const {
-  double dfunc, dpoly_ass, md, tq6, itq6, real_z, imag_z;
-  Vector dz, myrealvec, myimagvec, real_dz, imag_dz;
-  // The square root of -1
-  std::complex<double> ii( 0.0, 1.0 ), dp_x, dp_y, dp_z;
+  double dfunc, tq6, itq6;
+  Vector myrealvec, myimagvec, real_dz, imag_dz;
+  plumed_dbg_assert( OpenMP::getThreadNum()<harmonics.size() );
+  SphericalHarmonics& sph=harmonics[OpenMP::getThreadNum()];
 
   unsigned ncomp=2*tmom+1;
-  double sw, poly_ass, d2, dlen; std::complex<double> powered;
+  double sw, d2, dlen;
   for(unsigned i=1; i<myatoms.getNumberOfAtoms(); ++i) {
     Vector& distance=myatoms.getPosition(i);  // getSeparation( myatoms.getPosition(0), myatoms.getPosition(i) );
     if ( (d2=distance[0]*distance[0])<rcut2 &&
@@ -87,63 +88,36 @@ void Steinhardt::calculateVector( multicolvar::AtomValuePack& myatoms ) const {
       dlen = sqrt(d2);
       sw = switchingFunction.calculate( dlen, dfunc );
       accumulateSymmetryFunction( -1, i, sw, (+dfunc)*distance, (-dfunc)*Tensor( distance,distance ), myatoms );
-      double dlen3 = d2*dlen;
+      // Legendre polynomials and powers of (x+iy)/r for all m
+      sph.set( distance, dlen );
       // Do stuff for m=0
-      poly_ass=deriv_poly( 0, distance[2]/dlen, dpoly_ass );
-      // Derivatives of z/r wrt x, y, z
-      dz = -( distance[2] / dlen3 )*distance; dz[2] += (1.0 / dlen);
+      sph.get( tmom, 0, tq6, itq6, real_dz, imag_dz );
       // Derivative wrt to the vector connecting the two atoms
-      myrealvec = (+sw)*dpoly_ass*dz + poly_ass*(+dfunc)*distance;
+      myrealvec = (+sw)*real_dz + tq6*(+dfunc)*distance;
       // Accumulate the derivatives
-      accumulateSymmetryFunction( 2 + tmom, i, sw*poly_ass, myrealvec, Tensor( -myrealvec,distance ), myatoms );
-
-      // The complex number of which we have to take powers
-      std::complex<double> com1( distance[0]/dlen,distance[1]/dlen );
-      powered = std::complex<double>(1.0,0.0);
+      accumulateSymmetryFunction( 2 + tmom, i, sw*tq6, myrealvec, Tensor( -myrealvec,distance ), myatoms );
 
       // Do stuff for all other m values
       for(unsigned m=1; m<=tmom; ++m) {
-        // Calculate Legendre Polynomial
-        poly_ass=deriv_poly( m, distance[2]/dlen, dpoly_ass );
-        // Calculate power of complex number
-        // if(std::abs(com1)>epsilon) powered=pow(com1,m-1);
-        // else if(m==1) powered=std::complex<double>(1.,0);
-        // else powered = std::complex<double>(0.,0.);
-        // Real and imaginary parts of z
-        real_z = real(com1*powered); imag_z = imag(com1*powered );
-
-        // Calculate steinhardt parameter
-        tq6=poly_ass*real_z;   // Real part of steinhardt parameter
-        itq6=poly_ass*imag_z;  // Imaginary part of steinhardt parameter
-
-        // Derivatives wrt ( x/r + iy )^m
-        md=static_cast<double>(m);
-        dp_x = md*powered*( (1.0/dlen)-(distance[0]*distance[0])/dlen3-ii*(distance[0]*distance[1])/dlen3 );
-        dp_y = md*powered*( ii*(1.0/dlen)-(distance[0]*distance[1])/dlen3-ii*(distance[1]*distance[1])/dlen3 );
-        dp_z = md*powered*( -(distance[0]*distance[2])/dlen3-ii*(distance[1]*distance[2])/dlen3 );
-
-        // Derivatives of real and imaginary parts of above
-        real_dz[0] = real( dp_x ); real_dz[1] = real( dp_y ); real_dz[2] = real( dp_z );
-        imag_dz[0] = imag( dp_x ); imag_dz[1] = imag( dp_y ); imag_dz[2] = imag( dp_z );
+        // Real and imaginary parts of steinhardt parameter and their derivatives
+        sph.get( tmom, m, tq6, itq6, real_dz, imag_dz );
 
         // Complete derivative of steinhardt parameter
-        myrealvec = (+sw)*dpoly_ass*real_z*dz + (+dfunc)*distance*tq6 + (+sw)*poly_ass*real_dz;
-        myimagvec = (+sw)*dpoly_ass*imag_z*dz + (+dfunc)*distance*itq6 + (+sw)*poly_ass*imag_dz;
+        myrealvec = (+dfunc)*distance*tq6 + (+sw)*real_dz;
+        myimagvec = (+dfunc)*distance*itq6 + (+sw)*imag_dz;
 
         // Real part
         accumulateSymmetryFunction( 2 + tmom + m, i, sw*tq6, myrealvec, Tensor( -myrealvec,distance ), myatoms );
         // Imaginary part
         accumulateSymmetryFunction( 2+ncomp+tmom+m, i, sw*itq6, myimagvec, Tensor( -myimagvec,distance ), myatoms );
         // Store -m part of vector
-        double pref=pow(-1.0,m);
+        double pref=(m%2==0) ? 1.0 : -1.0;
         // -m part of vector is just +m part multiplied by (-1.0)**m and multiplied by complex
         // conjugate of Legendre polynomial
         // Real part
         accumulateSymmetryFunction( 2+tmom-m, i, pref*sw*tq6, pref*myrealvec, pref*Tensor( -myrealvec,distance ), myatoms );
         // Imaginary part
         accumulateSymmetryFunction( 2+ncomp+tmom-m, i, -pref*sw*itq6, -pref*myimagvec, pref*Tensor( myimagvec,distance ), myatoms );
-        // Calculate next power of complex number
-        powered *= com1;
       }
     }
   }
@@ -153,22 +127,5 @@ void Steinhardt::calculateVector( multicolvar::AtomValuePack& myatoms ) const {
   for(unsigned i=0; i<getNumberOfComponentsInVector(); ++i) myatoms.getUnderlyingMultiValue().quotientRule( 2+i, 2+i );
 }
 
-double Steinhardt::deriv_poly( const unsigned& m, const double& val, double& df ) const {
-  double fact=1.0;
-  for(unsigned j=1; j<=m; ++j) fact=fact*j;
-  double res=coeff_poly[m]*fact;
-
-  double pow=1.0, xi=val, dxi=1.0; df=0.0;
-  for(int i=m+1; i<=tmom; ++i) {
-    double fact=1.0;
-    for(unsigned j=i-m+1; j<=i; ++j) fact=fact*j;
-    res=res+coeff_poly[i]*fact*xi;
-    df = df + pow*coeff_poly[i]*fact*dxi;
-    xi=xi*val; dxi=dxi*val; pow+=1.0;
-  }
-  df = df*normaliz[m];
-  return normaliz[m]*res;
-}
-
 }
 }
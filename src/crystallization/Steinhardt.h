@@ -22,9 +22,9 @@
 #ifndef __PLUMED_crystallization_Steinhardt_h
 #define __PLUMED_crystallization_Steinhardt_h
 
-#include <complex>
 #include "tools/SwitchingFunction.h"
 #include "VectorMultiColvar.h"
+#include "SphericalHarmonics.h"
 
 namespace PLMD {
 namespace crystallization {
@@ -34,15 +34,14 @@ private:
   unsigned tmom;
   double rcut,rcut2;
   SwitchingFunction switchingFunction;
+/// The spherical harmonics (one for each OpenMP thread as they store the values for the current bond)
+  mutable std::vector<SphericalHarmonics> harmonics;
 protected:
-  std::vector<double> coeff_poly;
-  std::vector<double> normaliz;
   void setAngularMomentum( const unsigned& ang );
 public:
   static void registerKeywords( Keywords& keys );
   explicit Steinhardt( const ActionOptions& ao );
   void calculateVector( multicolvar::AtomValuePack& myatoms ) const ;
-  double deriv_poly( const unsigned&, const double&, double& ) const ;
 };
 
 }
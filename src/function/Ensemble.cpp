@@ -35,6 +35,12 @@ Calculates the replica averaging of a collective variable over multiple replicas
 
 Each collective variable is averaged separately and stored in a component labelled <em>label</em>.cvlabel.
 
+By default the weights, the averages and the moments are obtained with one reduction over the
+replicas each. With GATHER the arguments (and the energy used for REWEIGHT) of all the replicas
+are collected with a single message and the averages and moments are then computed locally.
+This is convenient with many replicas, when the latency of the communication between them dominates.
+The results are the same up to numerical rounding.
+
 \par Examples
 
 The following input tells plumed to calculate the distance between atoms 3 and 5
@@ -60,9 +66,14 @@ class Ensemble :
   bool     do_moments;
   bool     do_central;
   bool     do_powers;
+  bool     do_gather;
   double   kbt;
   double   moment;
   double   power;
+/// reduce weights, averages and moments over the replicas one at a time
+  void     reduceMoments(double &norm, double &fact, std::vector<double> &mean, std::vector<double> &v_moment, std::vector<double> &dv_moment);
+/// collect the arguments of all the replicas and calculate weights, averages and moments locally
+  void     gatherMoments(double &norm, double &fact, std::vector<double> &mean, std::vector<double> &v_moment, std::vector<double> &dv_moment);
 public:
   explicit Ensemble(const ActionOptions&);
   void     calculate();
@@ -77,6 +88,7 @@ void Ensemble::registerKeywords(Keywords& keys) {
   keys.use("ARG");
   keys.addFlag("REWEIGHT",false,"simple REWEIGHT using the latest ARG as energy");
   keys.addFlag("CENTRAL",false,"calculate a central moment instead of a standard moment");
+  keys.addFlag("GATHER",false,"collect the arguments of all the replicas with a single message and calculate averages and moments locally");
   keys.add("optional","TEMP","the system temperature - this is only needed if you are reweighting");
   keys.add("optional","MOMENT","the moment you want to calculate in alternative to the mean or the variance");
   keys.add("optional","POWER","the power of the mean (and moment)");
@@ -90,6 +102,7 @@ Ensemble::Ensemble(const ActionOptions&ao):
   do_moments(false),
   do_central(false),
   do_powers(false),
+  do_gather(false),
   kbt(-1.0),
   moment(0),
   power(0)
@@ -113,6 +126,8 @@ Ensemble::Ensemble(const ActionOptions&ao):
   if(power==1) error("POWER can be any number but for 0 and 1");
   if(power!=0) do_powers=true;
 
+  parseFlag("GATHER", do_gather);
+
   checkRead();
 
   master = (comm.Get_rank()==0);
@@ -150,12 +165,10 @@ Ensemble::Ensemble(const ActionOptions&ao):
   if(do_moments&&!do_central)  log.printf("  calculating also the %lf standard moment\n", moment);
   if(do_moments&&do_central)   log.printf("  calculating also the %lf central moment\n", moment);
   if(do_powers)                log.printf("  calculating the %lf power of the mean (and moment)\n", power);
+  if(do_gather)                log.printf("  collecting the arguments of all replicas with a single message\n");
 }
 
-void Ensemble::calculate() {
-  double norm = 0.0;
-  double fact = 0.0;
-
+void Ensemble::reduceMoments(double &norm, double &fact, vector<double> &mean, vector<double> &v_moment, vector<double> &dv_moment) {
   // calculate the weights either from BIAS
   if(do_reweight) {
     vector<double> bias;
@@ -177,10 +190,6 @@ void Ensemble::calculate() {
     fact = 1.0/norm;
   }
 
-  const double fact_kbt = fact/kbt;
-
-  vector<double> mean(narg);
-  vector<double> dmean(narg,fact);
   // calculate the mean
   if(master) {
     for(unsigned i=0; i<narg; ++i) mean[i] = fact*getArgument(i);
@@ -188,11 +197,8 @@ void Ensemble::calculate() {
   }
   comm.Sum(&mean[0], narg);
 
-  vector<double> v_moment, dv_moment;
   // calculate other moments
   if(do_moments) {
-    v_moment.resize(narg);
-    dv_moment.resize(narg);
     // standard moment
     if(!do_central) {
       if(master) {
@@ -226,6 +232,80 @@ void Ensemble::calculate() {
     }
     comm.Sum(&v_moment[0], narg);
   }
+}
+
+void Ensemble::gatherMoments(double &norm, double &fact, vector<double> &mean, vector<double> &v_moment, vector<double> &dv_moment) {
+  // the arguments (and the energy) of all the replicas are gathered in rows, then sent to the other processes of each replica
+  const unsigned nrow = getNumberOfArguments();
+  vector<double> all(ens_dim*nrow,0.0);
+  if(master) {
+    vector<double> mine(nrow);
+    for(unsigned i=0; i<nrow; ++i) mine[i] = getArgument(i);
+    if(ens_dim>1) multi_sim_comm.Allgather(mine, all);
+    else all = mine;
+  }
+  comm.Bcast(all,0);
+
+  // normalized weights of all the replicas
+  vector<double> w(ens_dim);
+  if(do_reweight) {
+    double maxbias = all[narg];
+    for(unsigned r=1; r<ens_dim; ++r) maxbias = std::max(maxbias, all[r*nrow+narg]);
+    for(unsigned r=0; r<ens_dim; ++r) {
+      w[r] = exp((all[r*nrow+narg]-maxbias)/kbt);
+      norm += w[r];
+    }
+    for(unsigned r=0; r<ens_dim; ++r) w[r] /= norm;
+  } else {
+    norm = static_cast<double>(ens_dim);
+    for(unsigned r=0; r<ens_dim; ++r) w[r] = 1.0/norm;
+  }
+  fact = w[my_repl];
+
+  // calculate the mean
+  for(unsigned i=0; i<narg; ++i) {
+    mean[i] = 0.0;
+    for(unsigned r=0; r<ens_dim; ++r) mean[i] += w[r]*all[r*nrow+i];
+  }
+
+  // calculate other moments
+  if(do_moments) {
+    for(unsigned i=0; i<narg; ++i) {
+      v_moment[i] = 0.0;
+      // standard moment
+      if(!do_central) {
+        for(unsigned r=0; r<ens_dim; ++r) {
+          const double tmp = w[r]*pow(all[r*nrow+i],moment-1);
+          v_moment[i]     += tmp*all[r*nrow+i];
+        }
+        dv_moment[i] = moment*(fact*pow(getArgument(i),moment-1));
+        // central moment
+      } else {
+        for(unsigned r=0; r<ens_dim; ++r) {
+          const double tmp = pow(all[r*nrow+i]-mean[i],moment-1);
+          v_moment[i]     += w[r]*tmp*(all[r*nrow+i]-mean[i]);
+        }
+        dv_moment[i] = moment*pow(getArgument(i)-mean[i],moment-1)*(fact-fact/norm);
+      }
+    }
+  }
+}
+
+void Ensemble::calculate() {
+  double norm = 0.0;
+  double fact = 0.0;
+
+  vector<double> mean(narg);
+  vector<double> v_moment, dv_moment;
+  if(do_moments) {
+    v_moment.resize(narg);
+    dv_moment.resize(narg);
+  }
+  if(do_gather) gatherMoments(norm, fact, mean, v_moment, dv_moment);
+  else reduceMoments(norm, fact, mean, v_moment, dv_moment);
+
+  const double fact_kbt = fact/kbt;
+  vector<double> dmean(narg,fact);
 
   // calculate powers of moments
   if(do_powers) {
@@ -0,0 +1,232 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "core/ActionRegister.h"
+#include "core/ActionPilot.h"
+#include "core/PlumedMain.h"
+#include "core/ActionSet.h"
+#include "core/StepProfile.h"
+#include "tools/Communicator.h"
+#include "tools/File.h"
+#include <algorithm>
+#include <cmath>
+
+namespace PLMD {
+namespace generic {
+
+using namespace std;
+
+//+PLUMEDOC GENERIC PROFILE
+/*
+Write the time spent in each phase of the calculation and in each action, every STRIDE steps.
+
+Contrary to \ref DEBUG DETAILED_TIMERS, which only reports the accumulated timings
+at the end of the simulation, this action writes a machine-readable
+profile of the last STRIDE steps while the simulation is running.
+Each step is divided into six phases:
+
+- prepare: activation of the actions that are due at this step
+- share: copy of the atoms sent by the MD code
+- wait: the time spent in receiving the atoms from the MD code. With domain decomposition
+  this includes the communication of the atoms among the MD processes. It does not include
+  the time spent by PLUMED processes waiting for each other, which is reported as mpi_wait
+- calc: forward loop over the actions
+- apply: backward loop over the actions
+- update: update of the actions (e.g. deposition of hills, printing)
+
+For each phase, and for each action within the calc, apply and update phases,
+the following statistics of the time spent per step are reported (in seconds):
+
+- calls: the number of steps in which the phase (or action) was executed
+- total and mean: the total and average time per step on the process writing the file
+- min, max and the 50th, 90th and 99th percentiles: computed on the times per step
+  of all the MPI processes
+- share: the fraction of the total time of the steps spent in this phase (or action)
+  on the process writing the file
+- rank_min and rank_max: the minimum and maximum of total over the MPI processes,
+  which show load imbalance
+- mpi_wait: (rank_max-rank_min) divided by the total time of the steps. This is the fraction of
+  the time that the fastest process spends waiting for the slowest one at the end of the
+  phase (or action), since each phase is concluded by a synchronization of the processes
+
+Rows with action equal to "total" refer to the whole phase.
+With FORMAT=csv a line is written for each phase and action, preceded by the step number.
+With FORMAT=json a single JSON object is written on one line every STRIDE steps.
+
+\par Examples
+
+The following input writes a profile of the last 1000 steps on the file profile.csv:
+\plumedfile
+d1: DISTANCE ATOMS=1,10
+PRINT ARG=d1 FILE=colvar
+PROFILE STRIDE=1000 FILE=profile.csv
+\endplumedfile
+
+*/
+//+ENDPLUMEDOC
+
+class Profile:
+  public ActionPilot
+{
+  OFile ofile;
+  bool json;
+  StepProfile profile;
+/// Number of slots in each phase
+  unsigned getNumberOfSlots(unsigned phase) const;
+public:
+  explicit Profile(const ActionOptions&);
+  ~Profile();
+  static void registerKeywords( Keywords& keys );
+  void calculate() {}
+  void apply() {}
+  void update();
+};
+
+PLUMED_REGISTER_ACTION(Profile,"PROFILE")
+
+void Profile::registerKeywords( Keywords& keys ) {
+  Action::registerKeywords(keys);
+  ActionPilot::registerKeywords(keys);
+  keys.add("compulsory","STRIDE","1000","the number of steps in each window of the profile");
+  keys.add("compulsory","FILE","the name of the file on which to write the profile");
+  keys.add("compulsory","FORMAT","csv","the format of the output file, csv or json");
+}
+
+Profile::Profile(const ActionOptions&ao):
+  Action(ao),
+  ActionPilot(ao),
+  json(false)
+{
+  if(plumed.stepProfile) error("PROFILE can be used only once");
+  string file;
+  parse("FILE",file);
+  string format;
+  parse("FORMAT",format);
+  if(format=="json") json=true;
+  else if(format!="csv") error("FORMAT should be either csv or json");
+  checkRead();
+
+  log.printf("  writing a %s profile every %d steps on file %s\n",format.c_str(),getStride(),file.c_str());
+  ofile.link(*this);
+  ofile.open(file);
+  if(!json) ofile.printf("step,phase,action,calls,total,mean,min,max,p50,p90,p99,share,rank_min,rank_max,mpi_wait\n");
+  plumed.stepProfile=&profile;
+}
+
+Profile::~Profile() {
+  if(plumed.stepProfile==&profile) plumed.stepProfile=NULL;
+}
+
+unsigned Profile::getNumberOfSlots(unsigned phase) const {
+  if(phase==StepProfile::calc || phase==StepProfile::apply || phase==StepProfile::update) return plumed.getActionSet().size()+1;
+  return 1;
+}
+
+static double percentile(const vector<double> & sorted, double p) {
+  if(sorted.empty()) return 0.0;
+  unsigned i=static_cast<unsigned>(std::ceil(p*sorted.size()));
+  return sorted[i>0?i-1:0];
+}
+
+void Profile::update() {
+  if(profile.getNumberOfSteps()==0) return;
+
+  // Gather the totals and the number of samples of all the processes
+  unsigned ntot=0;
+  for(unsigned i=0; i<StepProfile::nphases; ++i) ntot+=getNumberOfSlots(i);
+  const unsigned nrank=comm.Get_size(), rank=comm.Get_rank();
+  vector<double> totals(ntot*nrank,0.0);
+  vector<int> counts(ntot*nrank,0);
+  vector<double> local;
+  double steptime=0.0;
+  unsigned k=ntot*rank;
+  for(unsigned i=0; i<StepProfile::nphases; ++i) {
+    for(unsigned j=0; j<getNumberOfSlots(i); ++j) {
+      if(j<profile.getNumberOfSlots(i)) {
+        const vector<double> & s(profile.getSamples(i,j));
+        for(const auto & t : s) totals[k]+=t;
+        counts[k]=s.size();
+        local.insert(local.end(),s.begin(),s.end());
+      }
+      if(j==0) steptime+=totals[k];
+      k++;
+    }
+  }
+  comm.Sum(totals);
+  comm.Sum(counts);
+
+  // Gather the samples of all the processes, so that percentiles are global
+  vector<int> displs(nrank,0), sizes(nrank,0);
+  for(unsigned r=0; r<nrank; ++r) {
+    for(unsigned l=0; l<ntot; ++l) sizes[r]+=counts[ntot*r+l];
+    if(r>0) displs[r]=displs[r-1]+sizes[r-1];
+  }
+  vector<double> all;
+  if(nrank>1) {
+    all.resize(displs[nrank-1]+sizes[nrank-1]);
+    comm.Allgatherv(local,all,sizes.data(),displs.data());
+  } else all.swap(local);
+
+  const ActionSet & actionSet(plumed.getActionSet());
+  if(json) ofile.printf("{\"step\":%ld,\"steps\":%u,\"timings\":[",getStep(),profile.getNumberOfSteps());
+  bool first=true;
+  k=0;
+  vector<double> sorted;
+  for(unsigned i=0; i<StepProfile::nphases; ++i) {
+    for(unsigned j=0; j<getNumberOfSlots(i); ++j,++k) {
+      // displs is moved to the samples of the next slot of each process
+      sorted.resize(0);
+      for(unsigned r=0; r<nrank; ++r) {
+        sorted.insert(sorted.end(),all.begin()+displs[r],all.begin()+displs[r]+counts[ntot*r+k]);
+        displs[r]+=counts[ntot*r+k];
+      }
+      const unsigned calls=counts[ntot*rank+k];
+      if(calls==0) continue;
+      std::sort(sorted.begin(),sorted.end());
+      const double total=totals[ntot*rank+k];
+      double rmin=total, rmax=total;
+      for(unsigned r=0; r<nrank; ++r) {
+        rmin=std::min(rmin,totals[ntot*r+k]);
+        rmax=std::max(rmax,totals[ntot*r+k]);
+      }
+      const string action=(j==0?"total":actionSet[j-1]->getLabel());
+      const double share=(steptime>0.0?total/steptime:0.0);
+      const double mpiwait=(steptime>0.0?(rmax-rmin)/steptime:0.0);
+      if(json) {
+        ofile.printf("%s{\"phase\":\"%s\",\"action\":\"%s\",\"calls\":%u,\"total\":%.6e,\"mean\":%.6e,\"min\":%.6e,\"max\":%.6e,"
+                     "\"p50\":%.6e,\"p90\":%.6e,\"p99\":%.6e,\"share\":%.6e,\"rank_min\":%.6e,\"rank_max\":%.6e,\"mpi_wait\":%.6e}",
+                     first?"":",",StepProfile::getPhaseName(i),action.c_str(),calls,total,total/calls,
+                     sorted.front(),sorted.back(),percentile(sorted,0.5),percentile(sorted,0.9),percentile(sorted,0.99),share,rmin,rmax,mpiwait);
+      } else {
+        ofile.printf("%ld,%s,%s,%u,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e\n",
+                     getStep(),StepProfile::getPhaseName(i),action.c_str(),calls,total,total/calls,
+                     sorted.front(),sorted.back(),percentile(sorted,0.5),percentile(sorted,0.9),percentile(sorted,0.99),share,rmin,rmax,mpiwait);
+      }
+      first=false;
+    }
+  }
+  if(json) ofile.printf("]}\n");
+  ofile.flush();
+  profile.clear();
+}
+
+}
+}
@@ -64,6 +64,7 @@
 #include "CompiledExpression.h"
 #include "Operation.h"
 #include "ParsedExpression.h"
+#include <algorithm>
 #include <utility>
 
 namespace PLMD {
@@ -219,6 +220,103 @@ double CompiledExpression::evaluate() const {
 #endif
 }
 
+void CompiledExpression::evaluate(int n, const double* const* values, double* result) const {
+    const int blockSize = 64;
+    // The workspace holds blockSize values for each temporary.  It is thread local, so that
+    // this can be called concurrently and repeated calls do not allocate memory.
+    static thread_local vector<double> blockWorkspace;
+    static thread_local vector<double> blockArgs;
+    if (blockWorkspace.size() < workspace.size()*blockSize)
+        blockWorkspace.resize(workspace.size()*blockSize);
+    if (blockArgs.size() < argValues.size())
+        blockArgs.resize(argValues.size());
+    double* ws = &blockWorkspace[0];
+    for (int start = 0; start < n; start += blockSize) {
+        int m = min(blockSize, n-start);
+
+        // Copy the variables.
+
+        int v = 0;
+        for (map<string, int>::const_iterator iter = variableIndices.begin(); iter != variableIndices.end(); ++iter, ++v) {
+            double* dest = ws+iter->second*blockSize;
+            const double* src = values[v]+start;
+            for (int p = 0; p < m; p++)
+                dest[p] = src[p];
+        }
+
+        // Loop over the operations and evaluate each one over the whole block.
+
+        for (int step = 0; step < (int) operation.size(); step++) {
+            const vector<int>& args = arguments[step];
+            const Operation* op = operation[step];
+            int nargs = op->getNumArguments();
+            double* out = ws+target[step]*blockSize;
+            const double* a0 = ws+args[0]*blockSize;
+            const double* a1 = ws+(args.size() == 1 ? args[0]+1 : args[1])*blockSize;
+            switch (op->getId()) {
+                case Operation::CONSTANT: {
+                    double c = op->evaluate(NULL, dummyVariables);
+                    for (int p = 0; p < m; p++) out[p] = c;
+                    break;
+                }
+                case Operation::ADD:
+                    for (int p = 0; p < m; p++) out[p] = a0[p]+a1[p];
+                    break;
+                case Operation::SUBTRACT:
+                    for (int p = 0; p < m; p++) out[p] = a0[p]-a1[p];
+                    break;
+                case Operation::MULTIPLY:
+                    for (int p = 0; p < m; p++) out[p] = a0[p]*a1[p];
+                    break;
+                case Operation::DIVIDE:
+                    for (int p = 0; p < m; p++) out[p] = a0[p]/a1[p];
+                    break;
+                case Operation::NEGATE:
+                    for (int p = 0; p < m; p++) out[p] = -a0[p];
+                    break;
+                case Operation::SQUARE:
+                    for (int p = 0; p < m; p++) out[p] = a0[p]*a0[p];
+                    break;
+                case Operation::CUBE:
+                    for (int p = 0; p < m; p++) out[p] = a0[p]*a0[p]*a0[p];
+                    break;
+                case Operation::RECIPROCAL:
+                    for (int p = 0; p < m; p++) out[p] = 1.0/a0[p];
+                    break;
+                case Operation::SQRT:
+                    for (int p = 0; p < m; p++) out[p] = std::sqrt(a0[p]);
+                    break;
+                case Operation::EXP:
+                    for (int p = 0; p < m; p++) out[p] = std::exp(a0[p]);
+                    break;
+                case Operation::LOG:
+                    for (int p = 0; p < m; p++) out[p] = std::log(a0[p]);
+                    break;
+                case Operation::ADD_CONSTANT: {
+                    double c = static_cast<const Operation::AddConstant*>(op)->getValue();
+                    for (int p = 0; p < m; p++) out[p] = a0[p]+c;
+                    break;
+                }
+                case Operation::MULTIPLY_CONSTANT: {
+                    double c = static_cast<const Operation::MultiplyConstant*>(op)->getValue();
+                    for (int p = 0; p < m; p++) out[p] = a0[p]*c;
+                    break;
+                }
+                default:
+                    // Everything else is evaluated one point at a time.
+                    for (int p = 0; p < m; p++) {
+                        for (int i = 0; i < nargs; i++)
+                            blockArgs[i] = ws[(args.size() == 1 ? args[0]+i : args[i])*blockSize+p];
+                        out[p] = op->evaluate(&blockArgs[0], dummyVariables);
+                    }
+            }
+        }
+        const double* last = ws+(workspace.size()-1)*blockSize;
+        for (int p = 0; p < m; p++)
+            result[start+p] = last[p];
+    }
+}
+
 #ifdef LEPTON_USE_JIT
 static double evaluateOperation(Operation* op, double* args) {
     map<string, double>* dummyVariables = NULL;
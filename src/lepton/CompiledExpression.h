@@ -117,6 +117,15 @@ public:
      * Evaluate the expression.  The values of all variables should have been set before calling this.
      */
     double evaluate() const;
+    /**
+     * Evaluate the expression at n points at once.  values should have an entry for each variable, and values[i]
+     * should point to the n values of the i-th variable, with the variables taken in the order returned by
+     * getVariables().  The n results are stored in result.  The program is interpreted over blocks of points, so that the most common
+     * operations are performed in simple loops that the compiler can vectorize.  Unlike evaluate()
+     * this does not use the internal workspace, so it can be called from several threads at the same time.
+     * Locations set with setVariableLocations() are ignored.  result can be the same array as one of the values.
+     */
+    void evaluate(int n, const double* const* values, double* result) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
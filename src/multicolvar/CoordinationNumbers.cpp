@@ -24,6 +24,7 @@
 #include "tools/NeighborList.h"
 #include "core/ActionRegister.h"
 #include "tools/SwitchingFunction.h"
+#include "tools/OpenMP.h"
 
 #include <string>
 #include <cmath>
@@ -85,6 +86,15 @@ private:
   double rcut2;
   int r_power;
   SwitchingFunction switchingFunction;
+/// The neighbours of the central atom and their squared distances, used when the switching
+/// function is evaluated for all of them at once (one set per thread, to avoid reallocating them)
+  struct Neighbours {
+    std::vector<unsigned> index;
+    std::vector<double> dist2, sw, dfunc;
+  };
+  mutable std::vector<Neighbours> neighbours;
+/// Add the contribution of the neighbour i at squared distance d2
+  void addNeighbour( const unsigned& i, const double& d2, const double& sw, const double& dfunc, AtomValuePack& myatoms ) const ;
 public:
   static void registerKeywords( Keywords& keys );
   explicit CoordinationNumbers(const ActionOptions&);
@@ -153,11 +163,32 @@ CoordinationNumbers::CoordinationNumbers(const ActionOptions&ao):
 
   // And setup the ActionWithVessel
   std::vector<AtomNumber> all_atoms; setupMultiColvarBase( all_atoms ); checkRead();
+  if( switchingFunction.hasBatchedEvaluation() ) neighbours.resize( OpenMP::getNumThreads() );
+}
+
+void CoordinationNumbers::addNeighbour( const unsigned& i, const double& d2, const double& sw, const double& dfunc, AtomValuePack& myatoms ) const {
+  Vector& distance=myatoms.getPosition(i);
+  if(r_power > 0) {
+    double d = sqrt(d2); double raised = pow( d, r_power - 1 );
+    accumulateSymmetryFunction( 1, i, sw * raised * d,
+                                (dfunc * d * raised + sw * r_power) * distance,
+                                (-dfunc * d * raised - sw * r_power) * Tensor(distance, distance),
+                                myatoms );
+  } else {
+    accumulateSymmetryFunction( 1, i, sw, (dfunc)*distance, (-dfunc)*Tensor(distance,distance), myatoms );
+  }
 }
 
 double CoordinationNumbers::compute( const unsigned& tindex, AtomValuePack& myatoms ) const {
   // Calculate the coordination number
-  double dfunc, d2, sw, d, raised;
+  double dfunc, d2, sw;
+  // CUSTOM switching functions are computed for all the neighbours within the cutoff at once
+  const bool batched=switchingFunction.hasBatchedEvaluation();
+  Neighbours* nb=NULL;
+  if( batched ) {
+    nb=&neighbours[OpenMP::getThreadNum()];
+    nb->index.clear(); nb->dist2.clear();
+  }
   for(unsigned i=1; i<myatoms.getNumberOfAtoms(); ++i) {
     Vector& distance=myatoms.getPosition(i);
     if ( (d2=distance[0]*distance[0])<rcut2 &&
@@ -165,18 +196,18 @@ double CoordinationNumbers::compute( const unsigned& tindex, AtomValuePack& myat
          (d2+=distance[2]*distance[2])<rcut2 &&
          d2>epsilon ) {
 
-      sw = switchingFunction.calculateSqr( d2, dfunc );
-      if(r_power > 0) {
-        d = sqrt(d2); raised = pow( d, r_power - 1 );
-        accumulateSymmetryFunction( 1, i, sw * raised * d,
-                                    (dfunc * d * raised + sw * r_power) * distance,
-                                    (-dfunc * d * raised - sw * r_power) * Tensor(distance, distance),
-                                    myatoms );
+      if( batched ) {
+        nb->index.push_back(i); nb->dist2.push_back(d2);
       } else {
-        accumulateSymmetryFunction( 1, i, sw, (dfunc)*distance, (-dfunc)*Tensor(distance,distance), myatoms );
+        sw = switchingFunction.calculateSqr( d2, dfunc );
+        addNeighbour( i, d2, sw, dfunc, myatoms );
       }
     }
   }
+  if( batched ) {
+    switchingFunction.calculateSqr( nb->dist2, nb->sw, nb->dfunc );
+    for(unsigned k=0; k<nb->index.size(); ++k) addNeighbour( nb->index[k], nb->dist2[k], nb->sw[k], nb->dfunc[k], myatoms );
+  }
 
   return myatoms.getValue(1);
 }
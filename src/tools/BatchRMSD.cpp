@@ -0,0 +1,188 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "BatchRMSD.h"
+#include "Matrix.h"
+#include "OpenMP.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace PLMD {
+
+BatchRMSD::BatchRMSD():
+  natoms(0)
+{
+}
+
+void BatchRMSD::add(const RMSD& rmsd) {
+  RMSD myrmsd(rmsd);
+  plumed_massert(myrmsd.getMethod()=="OPTIMAL","BatchRMSD only works with OPTIMAL alignment");
+  plumed_massert(myrmsd.referenceCenterIsRemoved(),"BatchRMSD needs references with the center removed");
+  const vector<Vector> & ref(myrmsd.getReference());
+  const vector<double> & w(myrmsd.getAlign());
+  if(rmsds.empty()) natoms=ref.size();
+  plumed_massert(ref.size()==natoms,"all the frames should have the same number of atoms");
+
+// look for a frame with the same alignment weights
+  const unsigned nframes=rmsds.size();
+  unsigned set=alignsetframe.size();
+  for(unsigned s=0; s<alignsetframe.size(); s++) {
+    if(equal(w.begin(),w.end(),align.begin()+alignsetframe[s]*natoms)) {set=s; break;}
+  }
+  if(set==alignsetframe.size()) alignsetframe.push_back(nframes);
+  alignset.push_back(set);
+
+  references.insert(references.end(),ref.begin(),ref.end());
+  align.insert(align.end(),w.begin(),w.end());
+  maxalign.push_back(*max_element(w.begin(),w.end()));
+  double r=0.0;
+  for(unsigned iat=0; iat<natoms; iat++) r+=dotProduct(ref[iat],ref[iat])*w[iat];
+  rr11.push_back(r);
+  aleqdis.push_back(w==myrmsd.getDisplace());
+  rmsds.push_back(myrmsd);
+  rotations.resize(rmsds.size());
+  prefactors.resize(rmsds.size());
+  otherderivs.resize(rmsds.size());
+}
+
+void BatchRMSD::calculate(const vector<Vector>& positions,const vector<unsigned>& frames,vector<double>& distances,bool squared) {
+  plumed_massert(positions.size()==natoms,"wrong number of atoms");
+  const unsigned nsets=alignsetframe.size();
+  centered.resize(nsets*natoms);
+  rr00.resize(nsets);
+  distances.resize(frames.size());
+
+// the positions are centered once for each set of alignment weights
+  vector<bool> needed(nsets,false);
+  for(unsigned k=0; k<frames.size(); k++) needed[alignset[frames[k]]]=true;
+  for(unsigned s=0; s<nsets; s++) {
+    if(!needed[s]) continue;
+    const double* w=&align[alignsetframe[s]*natoms];
+    Vector* c=&centered[s*natoms];
+    Vector cpositions;
+    for(unsigned iat=0; iat<natoms; iat++) cpositions+=positions[iat]*w[iat];
+    double r=0.0;
+    for(unsigned iat=0; iat<natoms; iat++) {
+      c[iat]=positions[iat]-cpositions;
+      r+=dotProduct(c[iat],c[iat])*w[iat];
+    }
+    rr00[s]=r;
+  }
+
+// this is the same as RMSD::optimalAlignment<true,true>, but the derivatives
+// are only calculated later (if needed) from the stored rotation
+  #pragma omp parallel for num_threads(OpenMP::getNumThreads()) schedule(dynamic)
+  for(unsigned k=0; k<frames.size(); k++) {
+    const unsigned f=frames[k];
+    if(!aleqdis[f]) {
+      distances[k]=rmsds[f].calculate(positions,otherderivs[f],squared);
+      continue;
+    }
+    const unsigned s=alignset[f];
+    const double* w=&align[f*natoms];
+    const Vector* ref=&references[f*natoms];
+    const Vector* c=&centered[s*natoms];
+
+    Tensor rr01;
+    for(unsigned iat=0; iat<natoms; iat++) rr01+=Tensor(c[iat],ref[iat])*w[iat];
+
+    Matrix<double> m=Matrix<double>(4,4);
+    m[0][0]=2.0*(-rr01[0][0]-rr01[1][1]-rr01[2][2]);
+    m[1][1]=2.0*(-rr01[0][0]+rr01[1][1]+rr01[2][2]);
+    m[2][2]=2.0*(+rr01[0][0]-rr01[1][1]+rr01[2][2]);
+    m[3][3]=2.0*(+rr01[0][0]+rr01[1][1]-rr01[2][2]);
+    m[0][1]=2.0*(-rr01[1][2]+rr01[2][1]);
+    m[0][2]=2.0*(+rr01[0][2]-rr01[2][0]);
+    m[0][3]=2.0*(-rr01[0][1]+rr01[1][0]);
+    m[1][2]=2.0*(-rr01[0][1]-rr01[1][0]);
+    m[1][3]=2.0*(-rr01[0][2]-rr01[2][0]);
+    m[2][3]=2.0*(-rr01[1][2]-rr01[2][1]);
+    m[1][0] = m[0][1];
+    m[2][0] = m[0][2];
+    m[2][1] = m[1][2];
+    m[3][0] = m[0][3];
+    m[3][1] = m[1][3];
+    m[3][2] = m[2][3];
+
+    vector<double> eigenvals;
+    Matrix<double> eigenvecs;
+    int diagerror=diagMat(m, eigenvals, eigenvecs );
+    if (diagerror!=0) {
+      string sdiagerror;
+      Tools::convert(diagerror,sdiagerror);
+      plumed_merror("DIAGONALIZATION FAILED WITH ERROR CODE "+sdiagerror);
+    }
+
+    const double q[4]= {eigenvecs[0][0],eigenvecs[0][1],eigenvecs[0][2],eigenvecs[0][3]};
+    Tensor & rotation(rotations[f]);
+    rotation[0][0]=q[0]*q[0]+q[1]*q[1]-q[2]*q[2]-q[3]*q[3];
+    rotation[1][1]=q[0]*q[0]-q[1]*q[1]+q[2]*q[2]-q[3]*q[3];
+    rotation[2][2]=q[0]*q[0]-q[1]*q[1]-q[2]*q[2]+q[3]*q[3];
+    rotation[0][1]=2*(+q[0]*q[3]+q[1]*q[2]);
+    rotation[0][2]=2*(-q[0]*q[2]+q[1]*q[3]);
+    rotation[1][2]=2*(+q[0]*q[1]+q[2]*q[3]);
+    rotation[1][0]=2*(-q[0]*q[3]+q[1]*q[2]);
+    rotation[2][0]=2*(+q[0]*q[2]+q[1]*q[3]);
+    rotation[2][1]=2*(-q[0]*q[1]+q[2]*q[3]);
+
+    double prefactor=2.0;
+    if(!squared) prefactor*=0.5/sqrt(eigenvals[0]+rr00[s]+rr11[f]);
+    prefactors[f]=prefactor;
+
+// the MSD is recomputed from the rotation matrix, which gives less numerical noise
+    double dist=0.0;
+    for(unsigned iat=0; iat<natoms; iat++) {
+      const Vector d(c[iat] - matmul(rotation,ref[iat]));
+      dist+=w[iat]*modulo2(d);
+    }
+    if(!squared) dist=sqrt(dist);
+    distances[k]=dist;
+  }
+}
+
+double BatchRMSD::getDerivativeBound(unsigned frame,double msd) const {
+  plumed_assert(aleqdis[frame]);
+// derivatives are 2*w[i]*d[i], so that their squared norm is 4*sum_i w[i]^2*d[i]^2,
+// which is at most 4*max(w)*sum_i w[i]*d[i]^2 = 4*max(w)*msd
+  return 2.0*sqrt(maxalign[frame]*msd);
+}
+
+void BatchRMSD::addDerivatives(unsigned frame,double factor,vector<Vector>& derivatives) const {
+  plumed_assert(derivatives.size()==natoms);
+  if(!aleqdis[frame]) {
+    for(unsigned iat=0; iat<natoms; iat++) derivatives[iat]+=factor*otherderivs[frame][iat];
+    return;
+  }
+  const double* w=&align[frame*natoms];
+  const Vector* ref=&references[frame*natoms];
+  const Vector* c=&centered[alignset[frame]*natoms];
+  const Tensor & rotation(rotations[frame]);
+  const double prefactor=prefactors[frame];
+  for(unsigned iat=0; iat<natoms; iat++) {
+    const Vector d(c[iat] - matmul(rotation,ref[iat]));
+    derivatives[iat]+=factor*(prefactor*w[iat]*d);
+  }
+}
+
+}
@@ -0,0 +1,116 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_tools_BatchRMSD_h
+#define __PLUMED_tools_BatchRMSD_h
+
+#include "Vector.h"
+#include "Tensor.h"
+#include "RMSD.h"
+#include <vector>
+
+namespace PLMD {
+
+/** \ingroup TOOLBOX
+A class that calculates the RMSD (or MSD) of a configuration from many reference frames
+
+The reference frames must contain the same atoms and are set from \ref RMSD objects
+using optimal alignment (type OPTIMAL) with the center of the reference removed.
+The references are stored contiguously and the configuration is centered only once for
+each set of alignment weights (usually there is only one), then the rotations for the
+different frames are found in parallel using OpenMP threads.
+The calculation is split in two steps, so that derivatives can be calculated only
+for the frames where they are needed:
+
+\verbatim
+BatchRMSD batch;
+for(unsigned i=0; i<rmsds.size(); i++) batch.add(rmsds[i]);
+// calculate the distances from frames 0 and 2
+std::vector<unsigned> frames(2); frames[0]=0; frames[1]=2;
+std::vector<double> distances;
+batch.calculate(getPositions(),frames,distances,true);
+// add to derivs the derivatives of the distance from frame 2 multiplied by 0.5
+batch.addDerivatives(2,0.5,derivs);
+\endverbatim
+
+Frames where the alignment and displacement weights are different are calculated
+with RMSD::calculate().
+**/
+class BatchRMSD {
+/// number of atoms in each frame
+  unsigned natoms;
+/// the frames as set by the user
+  std::vector<RMSD> rmsds;
+/// reference positions of all frames, frame i starts at i*natoms
+  std::vector<Vector> references;
+/// alignment weights of all frames, frame i starts at i*natoms
+  std::vector<double> align;
+/// largest alignment weight of each frame
+  std::vector<double> maxalign;
+/// trace of reference*reference for each frame
+  std::vector<double> rr11;
+/// true if alignment and displacement weights are the same
+  std::vector<bool> aleqdis;
+/// set of alignment weights used by each frame
+  std::vector<unsigned> alignset;
+/// first frame using each set of alignment weights
+  std::vector<unsigned> alignsetframe;
+/// results of the last calculation:
+/// positions centered with each set of alignment weights
+  std::vector<Vector> centered;
+/// trace of positions*positions for each set of alignment weights
+  std::vector<double> rr00;
+/// rotation bringing each reference onto the positions
+  std::vector<Tensor> rotations;
+/// factor converting displacements into derivatives for each frame
+  std::vector<double> prefactors;
+/// derivatives for frames where alignment and displacement weights are different
+  std::vector<std::vector<Vector> > otherderivs;
+public:
+  BatchRMSD();
+/// add a reference frame
+  void add(const RMSD&);
+/// get the number of reference frames
+  unsigned getNumberOfReferences() const;
+/// calculate the distance of positions from the frames in the list (distances[i] is for frames[i])
+  void calculate(const std::vector<Vector>& positions,const std::vector<unsigned>& frames,std::vector<double>& distances,bool squared=false);
+/// add factor times the derivatives of the distance from a frame calculated in the last call of calculate()
+  void addDerivatives(unsigned frame,double factor,std::vector<Vector>& derivatives) const;
+/// check if a frame has the same weights for alignment and displacement
+  bool alignEqualsDisplace(unsigned frame) const;
+/// upper bound to the norm of the derivatives of the MSD from a frame, given the value of the MSD.
+/// Only valid when alignEqualsDisplace(frame) is true
+  double getDerivativeBound(unsigned frame,double msd) const;
+};
+
+inline
+unsigned BatchRMSD::getNumberOfReferences() const {
+  return rmsds.size();
+}
+
+inline
+bool BatchRMSD::alignEqualsDisplace(unsigned frame) const {
+  return aleqdis[frame];
+}
+
+}
+
+#endif
@@ -22,6 +22,7 @@
 #include "BiasRepresentation.h"
 #include "core/Value.h"
 #include "Communicator.h"
+#include "OpenMP.h"
 #include <iostream>
 
 namespace PLMD {
@@ -29,7 +30,7 @@ namespace PLMD {
 using namespace std;
 
 /// the constructor here
-BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communicator &cc ):hasgrid(false),rescaledToBias(false),mycomm(cc) {
+BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communicator &cc ):hasgrid(false),rescaledToBias(false),nkernels(0),pendingoffset(1,0),mycomm(cc) {
   lowI_=0.0;
   uppI_=0.0;
   doInt_=false;
@@ -40,7 +41,7 @@ BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communi
   }
 }
 /// overload the constructor: add the sigma  at constructor time
-BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communicator &cc,  const vector<double> & sigma ):hasgrid(false), rescaledToBias(false), histosigma(sigma),mycomm(cc) {
+BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communicator &cc,  const vector<double> & sigma ):hasgrid(false), rescaledToBias(false), nkernels(0), pendingoffset(1,0), histosigma(sigma),mycomm(cc) {
   lowI_=0.0;
   uppI_=0.0;
   doInt_=false;
@@ -52,7 +53,7 @@ BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communi
 }
 /// overload the constructor: add the grid at constructor time
 BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communicator &cc, const vector<string> & gmin, const vector<string> & gmax,
-                                       const vector<unsigned> & nbin, bool doInt, double lowI, double uppI ):hasgrid(false), rescaledToBias(false), mycomm(cc) {
+                                       const vector<unsigned> & nbin, bool doInt, double lowI, double uppI ):hasgrid(false), rescaledToBias(false), nkernels(0), pendingoffset(1,0), mycomm(cc) {
   ndim=tmpvalues.size();
   for(int  i=0; i<ndim; i++) {
     values.push_back(tmpvalues[i]);
@@ -65,7 +66,7 @@ BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communi
   addGrid(gmin,gmax,nbin);
 }
 /// overload the constructor with some external sigmas: needed for histogram
-BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communicator &cc, const vector<string> & gmin, const vector<string> & gmax, const vector<unsigned> & nbin, const vector<double> & sigma):hasgrid(false), rescaledToBias(false),histosigma(sigma),mycomm(cc) {
+BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communicator &cc, const vector<string> & gmin, const vector<string> & gmax, const vector<unsigned> & nbin, const vector<double> & sigma):hasgrid(false), rescaledToBias(false), nkernels(0), pendingoffset(1,0), histosigma(sigma),mycomm(cc) {
   lowI_=0.0;
   uppI_=0.0;
   doInt_=false;
@@ -79,7 +80,7 @@ BiasRepresentation::BiasRepresentation(const vector<Value*> & tmpvalues, Communi
 }
 
 void  BiasRepresentation::addGrid( const vector<string> & gmin, const vector<string> & gmax, const vector<unsigned> & nbin ) {
-  plumed_massert(hills.size()==0,"you can set the grid before loading the hills");
+  plumed_massert(nkernels==0,"you can set the grid before loading the hills");
   plumed_massert(hasgrid==false,"to build the grid you should not having the grid in this bias representation");
   string ss; ss="file.free";
   vector<Value*> vv; for(unsigned i=0; i<values.size(); i++)vv.push_back(values[i]);
@@ -91,7 +92,7 @@ bool BiasRepresentation::hasSigmaInInput() {
   if(histosigma.size()==0) {return false;} else {return true;}
 }
 void BiasRepresentation::setRescaledToBias(bool rescaled) {
-  plumed_massert(hills.size()==0,"you can set the rescaling function only before loading hills");
+  plumed_massert(nkernels==0,"you can set the rescaling function only before loading hills");
   rescaledToBias=rescaled;
 }
 const bool & BiasRepresentation::isRescaledToBias() {
@@ -141,7 +142,6 @@ void BiasRepresentation::pushKernel( IFile *ifile ) {
     ifile->scanField("biasf",dummy);
     Tools::convert(dummy,dummyd);
   } else {dummyd=1.0;}
-  biasf.push_back(dummyd);
   // the domain does not pertain to the kernel but to the values here defined
   string	mins,maxs,minv,maxv,mini,maxi; mins="min_"; maxs="max_";
   for(int i=0 ; i<ndim; i++) {
@@ -154,94 +154,138 @@ void BiasRepresentation::pushKernel( IFile *ifile ) {
       plumed_massert(maxi==maxv,"the input periodicity in hills and in value definition does not match"  );
     }
   }
-  // if grid is defined then it should be added on the grid
-  //cerr<<"now with "<<hills.size()<<endl;
-  if(hasgrid) {
-    vector<unsigned> nneighb;
-    if(doInt_&&(kk->getCenter()[0]+kk->getContinuousSupport()[0] > uppI_ || kk->getCenter()[0]-kk->getContinuousSupport()[0] < lowI_ )) {
-      nneighb=BiasGrid_->getNbin();
-    } else nneighb=kk->getSupport(BiasGrid_->getDx());
-    vector<Grid::index_t> neighbors=BiasGrid_->getNeighbors(kk->getCenter(),nneighb);
+  nkernels++;
+  if(!hasgrid) {
+    // without a grid only the extent of the kernel is needed
+    vector<double> ss,cc;
+    if(histosigma.size()!=0) {
+      ss=histosigma;
+    } else {
+      ss=kk->getContinuousSupport();
+    }
+    cc=kk->getCenter();
+    if(kmin.size()==0) {
+      kmin.resize(ndim,10.e20);
+      kmax.resize(ndim,-10.e20);
+      kbinsize.resize(ndim,10.e20);
+    }
+    int ndiv=10; // adjustable parameter: division per support
+    for(int j=0; j<ndim; j++) {
+      double dmin=cc[j]-ss[j];
+      double dmax=cc[j]+ss[j];
+      double ddiv=ss[j]/double(ndiv);
+      if(dmin<kmin[j])kmin[j]=dmin;
+      if(dmax>kmax[j])kmax[j]=dmax;
+      if(ddiv<kbinsize[j])kbinsize[j]=ddiv;
+    }
+    return;
+  }
+  // if grid is defined then the kernel is buffered and added on the grid with the others
+  if(pendingform && !kk->hasSameForm(*pendingform)) depositPendingKernels();
+  vector<unsigned> nneighb;
+  if(doInt_&&(kk->getCenter()[0]+kk->getContinuousSupport()[0] > uppI_ || kk->getCenter()[0]-kk->getContinuousSupport()[0] < lowI_ )) {
+    nneighb=BiasGrid_->getNbin();
+  } else nneighb=kk->getSupport(BiasGrid_->getDx());
+  vector<Grid::index_t> neighbors=BiasGrid_->getNeighbors(kk->getCenter(),nneighb);
+  pendingneighbors.insert(pendingneighbors.end(),neighbors.begin(),neighbors.end());
+  pendingoffset.push_back(pendingneighbors.size());
+  unsigned nparams=kk->getNumberOfParameters();
+  pendingparams.resize(pendingparams.size()+nparams);
+  kk->getParameters(&pendingparams[pendingparams.size()-nparams]);
+  pendingbiasf.push_back(dummyd);
+  if(!pendingform) pendingform=std::move(kk);
+  if(pendingneighbors.size()>=maxPendingPoints) depositPendingKernels();
+}
+
+void BiasRepresentation::depositPendingKernels() {
+  if(pendingbiasf.size()==0) return;
+  // kernel k contributes to the points pendingoffset[k],...,pendingoffset[k+1]-1 of the buffers
+  const unsigned nk=pendingbiasf.size();
+  const unsigned nparams=pendingform->getNumberOfParameters();
+  unsigned long npoints=pendingneighbors.size();
+  unsigned long stride=mycomm.Get_size();
+  unsigned long rank=mycomm.Get_rank();
+  vector<double> allbias(npoints,0.0);
+  vector<double> allder(ndim*npoints,0.0);
+  #pragma omp parallel num_threads(OpenMP::getNumThreads())
+  {
+    // each thread evaluates the kernels on its own copy of the values
+    vector<std::unique_ptr<Value>> vv(ndim);
+    vector<Value*> vv_ptr(ndim);
+    string str_min,str_max;
+    for(int j=0; j<ndim; ++j) {
+      vv[j].reset(new Value());
+      if(values[j]->isPeriodic()) {
+        values[j]->getDomain(str_min,str_max);
+        vv[j]->setDomain(str_min,str_max);
+      } else {
+        vv[j]->setNotPeriodic();
+      }
+      vv_ptr[j]=vv[j].get();
+    }
     vector<double> der(ndim);
     vector<double> xx(ndim);
-    if(mycomm.Get_size()==1) {
-      for(unsigned i=0; i<neighbors.size(); ++i) {
-        Grid::index_t ineigh=neighbors[i];
-        for(int j=0; j<ndim; ++j) {der[j]=0.0;}
-        BiasGrid_->getPoint(ineigh,xx);
-        // assign xx to a new vector of values
-        for(int j=0; j<ndim; ++j) {values[j]->set(xx[j]);}
+    // a single kernel per thread is set to each of the buffered ones in turn
+    KernelFunctions kernel(pendingform.get());
+    #pragma omp for schedule(dynamic)
+    for(unsigned k=0; k<nk; ++k) {
+      kernel.setParameters(&pendingparams[k*nparams]);
+      for(unsigned long p=pendingoffset[k]; p<pendingoffset[k+1]; ++p) {
+        if(p%stride!=rank) continue;
+        BiasGrid_->getPoint(pendingneighbors[p],xx);
+        for(int j=0; j<ndim; ++j) {vv[j]->set(xx[j]); der[j]=0.0;}
         double bias;
-        if(doInt_) bias=kk->evaluate(values,der,true,doInt_,lowI_,uppI_);
-        else bias=kk->evaluate(values,der,true);
+        if(doInt_) bias=kernel.evaluate(vv_ptr,der,true,doInt_,lowI_,uppI_);
+        else bias=kernel.evaluate(vv_ptr,der,true);
         if(rescaledToBias) {
-          double f=(biasf.back()-1.)/(biasf.back());
+          double f=(pendingbiasf[k]-1.)/(pendingbiasf[k]);
           bias*=f;
           for(int j=0; j<ndim; ++j) {der[j]*=f;}
         }
-        BiasGrid_->addValueAndDerivatives(ineigh,bias,der);
-      }
-    } else {
-      unsigned stride=mycomm.Get_size();
-      unsigned rank=mycomm.Get_rank();
-      vector<double> allder(ndim*neighbors.size(),0.0);
-      vector<double> allbias(neighbors.size(),0.0);
-      vector<double> tmpder(ndim);
-      for(unsigned i=rank; i<neighbors.size(); i+=stride) {
-        Grid::index_t ineigh=neighbors[i];
-        BiasGrid_->getPoint(ineigh,xx);
-        for(int j=0; j<ndim; ++j) {values[j]->set(xx[j]);}
-        if(doInt_) allbias[i]=kk->evaluate(values,der,true,doInt_,lowI_,uppI_);
-        else allbias[i]=kk->evaluate(values,der,true);
-        if(rescaledToBias) {
-          double f=(biasf.back()-1.)/(biasf.back());
-          allbias[i]*=f;
-          for(int j=0; j<ndim; ++j) {tmpder[j]*=f;}
-        }
-        // this solution with the temporary vector is rather bad, probably better to take
-        // a pointer of double as it was in old gaussian
-        for(int j=0; j<ndim; ++j) { allder[ndim*i+j]=tmpder[j]; tmpder[j]=0.;}
-      }
-      mycomm.Sum(allbias);
-      mycomm.Sum(allder);
-      for(unsigned i=0; i<neighbors.size(); ++i) {
-        Grid::index_t ineigh=neighbors[i];
-        for(int j=0; j<ndim; ++j) {der[j]=allder[ndim*i+j];}
-        BiasGrid_->addValueAndDerivatives(ineigh,allbias[i],der);
+        allbias[p]=bias;
+        for(int j=0; j<ndim; ++j) allder[ndim*p+j]=der[j];
       }
     }
   }
-  hills.emplace_back(std::move(kk));
+  if(stride>1) {
+    mycomm.Sum(allbias);
+    mycomm.Sum(allder);
+  }
+  // accumulate in reading order, so that the result does not depend
+  // on the number of threads and processes
+  vector<double> der(ndim);
+  for(unsigned long p=0; p<npoints; ++p) {
+    for(int j=0; j<ndim; ++j) {der[j]=allder[ndim*p+j];}
+    BiasGrid_->addValueAndDerivatives(pendingneighbors[p],allbias[p],der);
+  }
+  clearPendingKernels();
 }
+
+void BiasRepresentation::clearPendingKernels() {
+  pendingform.reset();
+  pendingparams.clear();
+  pendingbiasf.clear();
+  pendingneighbors.clear();
+  pendingoffset.assign(1,0);
+}
+
 int BiasRepresentation::getNumberOfKernels() {
-  return hills.size();
+  return nkernels;
 }
 Grid* BiasRepresentation::getGridPtr() {
   plumed_massert(hasgrid,"if you want the grid pointer then you should have defined a grid before");
+  depositPendingKernels();
   return BiasGrid_.get();
 }
 void BiasRepresentation::getMinMaxBin(vector<double> &vmin, vector<double> &vmax, vector<unsigned> &vbin) {
-  vector<double> ss,cc,binsize;
   vmin.clear(); vmin.resize(ndim,10.e20);
   vmax.clear(); vmax.resize(ndim,-10.e20);
   vbin.clear(); vbin.resize(ndim);
-  binsize.clear(); binsize.resize(ndim,10.e20);
-  int ndiv=10; // adjustable parameter: division per support
-  for(unsigned i=0; i<hills.size(); i++) {
-    if(histosigma.size()!=0) {
-      ss=histosigma;
-    } else {
-      ss=hills[i]->getContinuousSupport();
-    }
-    cc=hills[i]->getCenter();
-    for(int j=0; j<ndim; j++) {
-      double dmin=cc[j]-ss[j];
-      double dmax=cc[j]+ss[j];
-      double ddiv=ss[j]/double(ndiv);
-      if(dmin<vmin[j])vmin[j]=dmin;
-      if(dmax>vmax[j])vmax[j]=dmax;
-      if(ddiv<binsize[j])binsize[j]=ddiv;
-    }
+  vector<double> binsize(ndim,10.e20);
+  if(kmin.size()!=0) {
+    vmin=kmin;
+    vmax=kmax;
+    binsize=kbinsize;
   }
   for(int j=0; j<ndim; j++) {
     // reset to periodicity
@@ -254,8 +298,13 @@ void BiasRepresentation::getMinMaxBin(vector<double> &vmin, vector<double> &vmax
     vbin[j]=static_cast<unsigned>(ceil((vmax[j]-vmin[j])/binsize[j]) );
   }
 }
+
 void BiasRepresentation::clear() {
-  hills.clear();
+  nkernels=0;
+  clearPendingKernels();
+  kmin.clear();
+  kmax.clear();
+  kbinsize.clear();
   // clear the grid
   if(hasgrid) {
     BiasGrid_->clear();
@@ -39,6 +39,10 @@ namespace PLMD {
 /// this class implements a general purpose class that aims to
 /// provide a Grid/list
 /// transparently add gaussians to a bias
+///
+/// kernels are not stored: when a grid is present their parameters are buffered
+/// in a flat array and deposited in blocks (in parallel over threads and processes),
+/// otherwise only their extent is retained for getMinMaxBin()
 
 class BiasRepresentation {
 public:
@@ -73,7 +77,7 @@ public:
   const std::string & getName(unsigned i);
   /// get a pointer to a specific value
   Value* 	getPtrToValue(unsigned i);
-  /// get the pointer to the grid
+  /// get the pointer to the grid (deposits the buffered kernels first)
   Grid* 	getGridPtr();
   /// get a new histogram point from a file
   KernelFunctions* readFromPoint(IFile *ifile);
@@ -82,6 +86,12 @@ public:
   /// clear the representation (grid included)
   void clear();
 private:
+  /// maximum number of grid points buffered before the kernels are deposited
+  static const unsigned long maxPendingPoints=1048576;
+  /// deposit on the grid all the kernels read so far
+  void depositPendingKernels();
+  /// forget the kernels that have been buffered
+  void clearPendingKernels();
   int ndim;
   bool hasgrid;
   bool rescaledToBias;
@@ -90,8 +100,17 @@ private:
   double uppI_;
   std::vector<Value*> values;
   std::vector<std::string> names;
-  std::vector<std::unique_ptr<KernelFunctions>> hills;
-  std::vector<double> biasf;
+  unsigned long nkernels;
+  /// kernels read but not yet deposited. They all have the same form as pendingform,
+  /// their parameters are stored one after the other in pendingparams and the grid
+  /// neighbors of kernel k are pendingneighbors[pendingoffset[k]],...,pendingneighbors[pendingoffset[k+1]-1]
+  std::unique_ptr<KernelFunctions> pendingform;
+  std::vector<double> pendingparams;
+  std::vector<double> pendingbiasf;
+  std::vector<Grid::index_t> pendingneighbors;
+  std::vector<unsigned long> pendingoffset;
+  /// extent of the kernels read so far, used when there is no grid
+  std::vector<double> kmin,kmax,kbinsize;
   std::vector<double> histosigma;
   Communicator& mycomm;
   std::unique_ptr<Grid> BiasGrid_;
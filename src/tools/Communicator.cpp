@@ -152,6 +152,25 @@ void Communicator::Sum(Data data) {
 #endif
 }
 
+// data should be passed by value to allow conversions
+// cppcheck-suppress passedByValue
+Communicator::Request Communicator::Isum(Data data) {
+  Request req;
+#if defined(__PLUMED_HAS_MPI)
+  if(initialized()) {
+#if MPI_VERSION >= 3
+    MPI_Iallreduce(MPI_IN_PLACE,data.pointer,data.size,data.type,MPI_SUM,communicator,&req.r);
+#else
+    MPI_Allreduce(MPI_IN_PLACE,data.pointer,data.size,data.type,MPI_SUM,communicator);
+#endif
+  }
+#else
+  (void) data;
+  plumed_merror("you are trying to use an MPI function, but PLUMED has been compiled without MPI support");
+#endif
+  return req;
+}
+
 // data should be passed by value to allow conversions
 // cppcheck-suppress passedByValue
 Communicator::Request Communicator::Isend(ConstData data,int source,int tag) {
@@ -244,8 +263,15 @@ bool Communicator::initialized() {
   else return false;
 }
 
+Communicator::Request::Request() {
+#ifdef __PLUMED_HAS_MPI
+  r=MPI_REQUEST_NULL;
+#endif
+}
+
 void Communicator::Request::wait(Status&s) {
 #ifdef __PLUMED_HAS_MPI
+  if(r==MPI_REQUEST_NULL) return;
   plumed_massert(initialized(),"you are trying to use an MPI function, but MPI is not initialized");
   if(&s==&StatusIgnore) MPI_Wait(&r,MPI_STATUS_IGNORE);
   else MPI_Wait(&r,&s.s);
@@ -137,6 +137,8 @@ public:
   class Request {
   public:
     MPI_Request r;
+/// Constructs an already completed request
+    Request();
     void wait(Status&s=StatusIgnore);
   };
 /// Default constructor
@@ -182,6 +184,15 @@ public:
 /// Wrapper for MPI_Allreduce with MPI_SUM (reference)
   template <class T> void Sum(T&buf) {Sum(Data(buf));}
 
+/// Wrapper for MPI_Iallreduce with MPI_SUM (data struct).
+/// The buffer should not be accessed until the returned request has been waited for.
+/// With MPI libraries older than version 3 the reduction is done immediately.
+  Request Isum(Data);
+/// Wrapper for MPI_Iallreduce with MPI_SUM (pointer)
+  template <class T> Request Isum(T*buf,int count) {return Isum(Data(buf,count));}
+/// Wrapper for MPI_Iallreduce with MPI_SUM (reference)
+  template <class T> Request Isum(T&buf) {return Isum(Data(buf));}
+
 /// Wrapper for MPI_Bcast (data struct)
   void Bcast(Data,int);
 /// Wrapper for MPI_Bcast (pointer)
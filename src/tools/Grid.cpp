@@ -28,6 +28,7 @@
 #include "KernelFunctions.h"
 #include "RootFindingBase.h"
 #include "Communicator.h"
+#include "OpenMP.h"
 
 #include <vector>
 #include <cmath>
@@ -35,6 +36,7 @@
 #include <sstream>
 #include <cstdio>
 #include <cfloat>
+#include <algorithm>
 
 using namespace std;
 namespace PLMD {
@@ -458,7 +460,7 @@ double Grid::getValueAndDerivatives
       for(unsigned j=0; j<dimension_; ++j) {
         int x0=1;
         if(nindices[j]==indices[j]) x0=0;
-        double dx=getDx()[j];
+        double dx=dx_[j];
         X=fabs((x[j]-xfloor[j])/dx-(double)x0);
         X2=X*X;
         X3=X2*X;
@@ -697,13 +699,61 @@ Grid* Grid::create(const std::string& funcl, const std::vector<Value*> & args, I
   return grid.release();
 }
 
-// Sparse version of grid with map
+// Sparse version of grid with hash table
+const unsigned SparseGrid::emptySlot=~0U;
+
+// multiplicative (Fibonacci) hashing, spreads neighboring grid indices over the table
+static inline unsigned hashGridIndex(Grid::index_t index, unsigned bits) {
+  return static_cast<unsigned>((static_cast<unsigned long long>(index)*11400714819323198485ULL)>>(64-bits));
+}
+
 void SparseGrid::clear() {
-  map_.clear();
+  table_.clear();
+  keys_.clear();
+  records_.clear();
+  tableBits_=0;
+}
+
+void SparseGrid::rehash(unsigned bits) {
+  tableBits_=bits;
+  table_.assign(1U<<bits,emptySlot);
+  const unsigned mask=(1U<<bits)-1;
+  for(unsigned k=0; k<keys_.size(); ++k) {
+    unsigned slot=hashGridIndex(keys_[k],bits);
+    while(table_[slot]!=emptySlot) slot=(slot+1)&mask;
+    table_[slot]=k;
+  }
+}
+
+unsigned SparseGrid::findRecord(index_t index) const {
+  if(table_.empty()) return emptySlot;
+  const unsigned mask=table_.size()-1;
+  unsigned slot=hashGridIndex(index,tableBits_);
+  while(table_[slot]!=emptySlot) {
+    if(keys_[table_[slot]]==index) return table_[slot];
+    slot=(slot+1)&mask;
+  }
+  return emptySlot;
+}
+
+unsigned SparseGrid::getRecord(index_t index) {
+  unsigned k=findRecord(index);
+  if(k!=emptySlot) return k;
+// keep the load factor below 1/2
+  if(2*(keys_.size()+1)>table_.size()) rehash(tableBits_>0?tableBits_+1:4);
+  plumed_massert(keys_.size()<emptySlot,"too many points in sparse grid");
+  k=keys_.size();
+  keys_.push_back(index);
+  records_.resize(records_.size()+recordSize_,0.0);
+  const unsigned mask=table_.size()-1;
+  unsigned slot=hashGridIndex(index,tableBits_);
+  while(table_[slot]!=emptySlot) slot=(slot+1)&mask;
+  table_[slot]=k;
+  return k;
 }
 
 Grid::index_t SparseGrid::getSize() const {
-  return map_.size();
+  return keys_.size();
 }
 
 Grid::index_t SparseGrid::getMaxSize() const {
@@ -759,47 +809,48 @@ void Grid::findSetOfPointsOnContour(const double& target, const std::vector<bool
 
 double SparseGrid::getValue(index_t index)const {
   plumed_assert(index<maxsize_);
-  double value=0.0;
-  const auto it=map_.find(index);
-  if(it!=map_.end()) value=it->second;
-  return value;
+  const unsigned k=findRecord(index);
+  if(k==emptySlot) return 0.0;
+  return records_[k*recordSize_];
 }
 
 double SparseGrid::getValueAndDerivatives
 (index_t index, vector<double>& der)const {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  double value=0.0;
-  for(unsigned int i=0; i<dimension_; ++i) der[i]=0.0;
-  const auto it=map_.find(index);
-  if(it!=map_.end()) value=it->second;
-  const auto itder=der_.find(index);
-  if(itder!=der_.end()) der=itder->second;
-  return value;
+  const unsigned k=findRecord(index);
+  if(k==emptySlot) {
+    for(unsigned int i=0; i<dimension_; ++i) der[i]=0.0;
+    return 0.0;
+  }
+  const double* record=&records_[k*recordSize_];
+  for(unsigned int i=0; i<dimension_; ++i) der[i]=record[i+1];
+  return record[0];
 }
 
 void SparseGrid::setValue(index_t index, double value) {
   plumed_assert(index<maxsize_ && !usederiv_);
-  map_[index]=value;
+  records_[getRecord(index)]=value;
 }
 
 void SparseGrid::setValueAndDerivatives
 (index_t index, double value, vector<double>& der) {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  map_[index]=value;
-  der_[index]=der;
+  double* record=&records_[getRecord(index)*recordSize_];
+  record[0]=value;
+  for(unsigned int i=0; i<dimension_; ++i) record[i+1]=der[i];
 }
 
 void SparseGrid::addValue(index_t index, double value) {
   plumed_assert(index<maxsize_ && !usederiv_);
-  map_[index]+=value;
+  records_[getRecord(index)]+=value;
 }
 
 void SparseGrid::addValueAndDerivatives
 (index_t index, double value, vector<double>& der) {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  map_[index]+=value;
-  der_[index].resize(dimension_);
-  for(unsigned int i=0; i<dimension_; ++i) der_[index][i]+=der[i];
+  double* record=&records_[getRecord(index)*recordSize_];
+  record[0]+=value;
+  for(unsigned int i=0; i<dimension_; ++i) record[i+1]+=der[i];
 }
 
 void SparseGrid::writeToFile(OFile& ofile) {
@@ -808,8 +859,10 @@ void SparseGrid::writeToFile(OFile& ofile) {
   double f;
   writeHeader(ofile);
   ofile.fmtField(" "+fmt_);
-  for(const auto & it : map_) {
-    index_t i=it.first;
+// points are written in order of grid index
+  vector<index_t> sorted(keys_);
+  std::sort(sorted.begin(),sorted.end());
+  for(const auto & i : sorted) {
     xx=getPoint(i);
     if(usederiv_) {f=getValueAndDerivatives(i,der);}
     else {f=getValue(i);}
@@ -828,41 +881,6 @@ void SparseGrid::writeToFile(OFile& ofile) {
   }
 }
 
-
-void Grid::projectOnLowDimension(double &val, std::vector<int> &vHigh, WeightBase * ptr2obj ) {
-  unsigned i=0;
-  for(i=0; i<vHigh.size(); i++) {
-    if(vHigh[i]<0) { // this bin needs to be integrated out
-      // parallelize here???
-      for(unsigned j=0; j<(getNbin())[i]; j++) {
-        vHigh[i]=int(j);
-        projectOnLowDimension(val,vHigh,ptr2obj); // recursive function: this is the core of the mechanism
-        vHigh[i]=-1;
-      }
-      return; //
-    }
-  }
-  // when there are no more bin to dig in then retrieve the value
-  if(i==vHigh.size()) {
-    //std::cerr<<"POINT: ";
-    //for(unsigned j=0;j<vHigh.size();j++){
-    //   std::cerr<<vHigh[j]<<" ";
-    //}
-    std::vector<unsigned> vv(vHigh.size());
-    for(unsigned j=0; j<vHigh.size(); j++)vv[j]=unsigned(vHigh[j]);
-    //
-    // this is the real assignment !!!!! (hack this to have bias or other stuff)
-    //
-
-    // this case: produce fes
-    //val+=exp(beta*getValue(vv)) ;
-    double myv=getValue(vv);
-    val=ptr2obj->projectInnerLoop(val,myv) ;
-    // to be added: bias (same as before without negative sign)
-    //std::cerr<<" VAL: "<<val <<endl;
-  }
-}
-
 Grid Grid::project(const std::vector<std::string> & proj, WeightBase *ptr2obj ) {
   // find extrema only for the projection
   vector<string>   smallMin,smallMax;
@@ -913,29 +931,51 @@ Grid Grid::project(const std::vector<std::string> & proj, WeightBase *ptr2obj )
   //     cerr<<"Dimension to integrate "<<toBeIntegrated[i]<<endl;
   //}
 
-  // loop over all the points in the Grid, find the corresponding fixed index, rotate over all the other ones
-  for(unsigned i=0; i<smallgrid.getSize(); i++) {
-    std::vector<unsigned> v;
-    v=smallgrid.getIndices(i);
-    std::vector<int> vHigh((getArgNames()).size(),-1);
-    for(unsigned j=0; j<dimMapping.size(); j++)vHigh[dimMapping[j]]=int(v[j]);
-    // the vector vhigh now contains at the beginning the index of the low dimension and -1 for the values that need to be integrated
-    double initval=0.;
-    projectOnLowDimension(initval,vHigh, ptr2obj);
-    smallgrid.setValue(i,initval);
+  // column-major strides of this grid
+  vector<index_t> stride(dimension_);
+  stride[0]=1;
+  for(unsigned i=1; i<dimension_; i++) stride[i]=stride[i-1]*nbin_[i-1];
+  // the first dimension to be integrated is summed in the innermost loop, which is
+  // contiguous in memory when it is the first dimension of the grid;
+  // the other ones are visited as an odometer in column-major order
+  unsigned ninner=1;
+  index_t innerstride=1;
+  vector<unsigned> outer;
+  if(toBeIntegrated.size()>0) {
+    ninner=nbin_[toBeIntegrated[0]];
+    innerstride=stride[toBeIntegrated[0]];
+    outer.assign(toBeIntegrated.begin()+1,toBeIntegrated.end());
   }
-  // reset to zero just for biasing (this option can be evtl enabled in a future...)
-  //double vmin;vmin=-smallgrid.getMinValue()+1;
-  for(unsigned i=0; i<smallgrid.getSize(); i++) {
-    //         //if(dynamic_cast<BiasWeight*>(ptr2obj)){
-    //         //        smallgrid.addValue(i,vmin);// go to 1
-    //         //}
-    double vv=smallgrid.getValue(i);
-    smallgrid.setValue(i,ptr2obj->projectOuterLoop(vv));
-    //         //if(dynamic_cast<BiasWeight*>(ptr2obj)){
-    //         //        smallgrid.addValue(i,-vmin);// bring back to the value
-    //         //}
+  vector<double> projected(smallgrid.getSize());
+  // weights that are not thread safe are used by a single thread
+  const unsigned nt=(ptr2obj->threadSafe()?OpenMP::getNumThreads():1);
+  #pragma omp parallel num_threads(nt)
+  {
+    vector<double> row(ninner);
+    vector<unsigned> counter(outer.size());
+    #pragma omp for
+    for(index_t i=0; i<smallgrid.getSize(); i++) {
+      vector<unsigned> v=smallgrid.getIndices(i);
+      index_t base=0;
+      for(unsigned j=0; j<dimMapping.size(); j++) base+=v[j]*stride[dimMapping[j]];
+      for(unsigned k=0; k<outer.size(); k++) counter[k]=0;
+      double val=0.;
+      while(true) {
+        index_t start=base;
+        for(unsigned k=0; k<outer.size(); k++) start+=counter[k]*stride[outer[k]];
+        for(unsigned k=0; k<ninner; k++) row[k]=getValue(start+k*innerstride);
+        val=ptr2obj->projectInnerSum(val,row.data(),ninner);
+        unsigned k=0;
+        for(; k<outer.size(); k++) {
+          if(++counter[k]<nbin_[outer[k]]) break;
+          counter[k]=0;
+        }
+        if(k==outer.size()) break;
+      }
+      projected[i]=ptr2obj->projectOuterLoop(val);
+    }
   }
+  for(index_t i=0; i<smallgrid.getSize(); i++) smallgrid.setValue(i,projected[i]);
 
   return smallgrid;
 }
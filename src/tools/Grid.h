@@ -36,6 +36,14 @@ class WeightBase {
 public:
   virtual double projectInnerLoop(double &input, double &v)=0;
   virtual double projectOuterLoop(double &v)=0;
+/// apply projectInnerLoop to n consecutive values; override it to avoid a virtual call per value
+  virtual double projectInnerSum(double input, const double* v, unsigned n) {
+    for(unsigned i=0; i<n; i++) {double vv=v[i]; input=projectInnerLoop(input,vv);}
+    return input;
+  }
+/// return true if projectInnerSum() and projectOuterLoop() can be called by several threads
+/// at the same time, so that Grid::project() can compute the projection in parallel
+  virtual bool threadSafe() const { return false; }
   virtual ~WeightBase() {}
 };
 
@@ -44,7 +52,12 @@ public:
   double beta,invbeta;
   explicit BiasWeight(double v) {beta=v; invbeta=1./beta;}
   double projectInnerLoop(double &input, double &v) {return  input+exp(beta*v);}
+  double projectInnerSum(double input, const double* v, unsigned n) {
+    for(unsigned i=0; i<n; i++) input+=exp(beta*v[i]);
+    return input;
+  }
   double projectOuterLoop(double &v) {return -invbeta*std::log(v);}
+  bool threadSafe() const { return true; }
 };
 
 class ProbWeight:public WeightBase {
@@ -52,7 +65,12 @@ public:
   double beta,invbeta;
   explicit ProbWeight(double v) {beta=v; invbeta=1./beta;}
   double projectInnerLoop(double &input, double &v) {return  input+v;}
+  double projectInnerSum(double input, const double* v, unsigned n) {
+    for(unsigned i=0; i<n; i++) input+=v[i];
+    return input;
+  }
   double projectOuterLoop(double &v) {return -invbeta*std::log(v);}
+  bool threadSafe() const { return true; }
 };
 
 
@@ -210,9 +228,9 @@ public:
   virtual ~Grid() {}
 
 /// project a high dimensional grid onto a low dimensional one: this should be changed at some time
-/// to enable many types of weighting
+/// to enable many types of weighting. The integrated dimensions are visited in memory order and,
+/// if the weight is WeightBase::threadSafe(), the points of the projection are computed in parallel
   Grid project( const std::vector<std::string> & proj, WeightBase *ptr2obj  );
-  void projectOnLowDimension(double &val, std::vector<int> &varHigh, WeightBase* ptr2obj );
 /// set output format
   void setOutputFmt(const std::string & ss) {fmt_=ss;}
 /// Integrate the function calculated on the grid
@@ -225,11 +243,33 @@ public:
 };
 
 
+/// \ingroup TOOLBOX
+/// Grid storing only the populated points.
+/// Points are kept in an open-addressing hash table (linear probing) that maps
+/// the grid index to a record holding the value followed by the derivatives,
+/// all records being stored contiguously in insertion order.
 class SparseGrid : public Grid
 {
 
-  std::map<index_t,double> map_;
-  std::map< index_t,std::vector<double> > der_;
+/// empty slot in the hash table
+  static const unsigned emptySlot;
+/// hash table: position of the record in keys_, or emptySlot
+  std::vector<unsigned> table_;
+/// grid indices of the populated points
+  std::vector<index_t> keys_;
+/// value and derivatives of the populated points
+  std::vector<double> records_;
+/// number of doubles per record
+  unsigned recordSize_;
+/// log2 of the size of the hash table
+  unsigned tableBits_;
+
+/// find the record of a given grid index, return emptySlot if not populated
+  unsigned findRecord(index_t index) const;
+/// find the record of a given grid index, create it if not populated
+  unsigned getRecord(index_t index);
+/// resize the hash table to 2^bits slots
+  void rehash(unsigned bits);
 
 protected:
   void clear();
@@ -238,7 +278,9 @@ public:
   SparseGrid(const std::string& funcl, const std::vector<Value*> & args, const std::vector<std::string> & gmin,
              const std::vector<std::string> & gmax,
              const std::vector<unsigned> & nbin, bool dospline, bool usederiv):
-    Grid(funcl,args,gmin,gmax,nbin,dospline,usederiv,false) {}
+    Grid(funcl,args,gmin,gmax,nbin,dospline,usederiv,false),
+    recordSize_(usederiv?dimension_+1:1),
+    tableBits_(0) {}
 
   index_t getSize() const;
   index_t getMaxSize() const;
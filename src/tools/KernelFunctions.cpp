@@ -382,6 +382,22 @@ double KernelFunctions::evaluate( const std::vector<Value*>& pos, std::vector<do
   return kval;
 }
 
+bool KernelFunctions::hasSameForm( const KernelFunctions& other ) const {
+  return dtype==other.dtype && ktype==other.ktype && center.size()==other.center.size() && width.size()==other.width.size();
+}
+
+void KernelFunctions::getParameters( double* params ) const {
+  params[0]=height;
+  for(unsigned i=0; i<center.size(); ++i) params[1+i]=center[i];
+  for(unsigned i=0; i<width.size(); ++i) params[1+center.size()+i]=width[i];
+}
+
+void KernelFunctions::setParameters( const double* params ) {
+  height=params[0];
+  for(unsigned i=0; i<center.size(); ++i) center[i]=params[1+i];
+  for(unsigned i=0; i<width.size(); ++i) width[i]=params[1+center.size()+i];
+}
+
 KernelFunctions* KernelFunctions::read( IFile* ifile, const bool& cholesky, const std::vector<std::string>& valnames ) {
   double h;
   if( !ifile->scanField("height",h) ) return NULL;;
@@ -65,6 +65,14 @@ public:
   double evaluate( const std::vector<Value*>& pos, std::vector<double>& derivatives, bool usederiv=true, bool doInt=false, double lowI_=-1, double uppI_=-1 ) const;
 /// Read a kernel function from a file
   static KernelFunctions* read( IFile* ifile, const bool& cholesky, const std::vector<std::string>& valnames );
+/// Check if two kernels have the same type, metric and number of parameters
+  bool hasSameForm( const KernelFunctions& other ) const;
+/// Get the number of parameters (height, center and width) that define the kernel
+  unsigned getNumberOfParameters() const;
+/// Copy the height, the center and the width of the kernel to a contiguous array
+  void getParameters( double* params ) const;
+/// Set the height, the center and the width of the kernel from a contiguous array
+  void setParameters( const double* params );
 };
 
 inline
@@ -89,5 +97,10 @@ std::vector<double> KernelFunctions::getCenter() const {
   return center;
 }
 
+inline
+unsigned KernelFunctions::getNumberOfParameters() const {
+  return 1+center.size()+width.size();
+}
+
 }
 #endif
@@ -0,0 +1,215 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "MappedRecords.h"
+#include "Exception.h"
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#ifdef __PLUMED_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace PLMD {
+
+namespace {
+
+/// Layout of the header at the beginning of the file.
+/// The magic string is written last so that a file with a partially written header is ignored.
+struct MappedRecordsHeader {
+  char magic[8];
+  unsigned long long recordSize;
+  std::atomic<unsigned long long> nrecords;
+};
+
+const char mappedRecordsMagic[8]= {'P','L','U','M','E','D','R','1'};
+
+inline MappedRecordsHeader* getHeader(void* base) {
+  return static_cast<MappedRecordsHeader*>(base);
+}
+
+}
+
+const size_t MappedRecords::headerSize=64;
+
+MappedRecords::MappedRecords():
+  fd(-1),
+  base(NULL),
+  mapped(0),
+  recordSize(0),
+  nread(0),
+  device(0),
+  inode(0),
+  writer(false)
+{
+  static_assert(sizeof(MappedRecordsHeader)<=64,"header of mapped records is too large");
+}
+
+MappedRecords::~MappedRecords() {
+  close();
+}
+
+void MappedRecords::map(size_t n) {
+#ifdef __PLUMED_HAS_MMAP
+  if(base) munmap(base,mapped);
+  base=mmap(NULL,n,PROT_READ|(writer?PROT_WRITE:0),MAP_SHARED,fd,0);
+  if(base==MAP_FAILED) {
+    base=NULL; mapped=0;
+    plumed_merror("cannot map file " + path + " in memory");
+  }
+  mapped=n;
+#else
+  plumed_merror("mapping files in memory requires plumed to be compiled with mmap");
+#endif
+}
+
+bool MappedRecords::checkHeader() const {
+  const MappedRecordsHeader* header=getHeader(base);
+  if(std::memcmp(header->magic,mappedRecordsMagic,8)!=0) {
+    for(unsigned i=0; i<8; i++) plumed_massert(header->magic[i]==0,"file " + path + " was not written by plumed");
+    return false;
+  }
+  plumed_massert(header->recordSize==recordSize,"file " + path + " contains records of a different size");
+  plumed_massert(header->nrecords.is_lock_free(),"atomic access to mapped records is not available");
+  return true;
+}
+
+void MappedRecords::openWrite(const std::string& p, unsigned n, bool append) {
+#ifdef __PLUMED_HAS_MMAP
+  plumed_massert(fd<0,"file " + path + " is already open");
+  path=p; recordSize=n; writer=true; nread=0;
+// the old file is removed rather than truncated so that processes that are still reading it are not affected
+  if(!append) unlink(path.c_str());
+  fd=open(path.c_str(),O_RDWR|O_CREAT,0644);
+  plumed_massert(fd>=0,"cannot open file " + path + " for writing");
+  struct stat st; fstat(fd,&st);
+  device=st.st_dev; inode=st.st_ino;
+  if(st.st_size>=static_cast<off_t>(headerSize)) {
+    map(st.st_size);
+    if(checkHeader()) {
+      nread=getHeader(base)->nrecords.load();
+      return;
+    }
+  } else {
+    size_t size=headerSize+1024*sizeof(double)*recordSize;
+    if(ftruncate(fd,size)!=0) plumed_merror("cannot resize file " + path);
+    map(size);
+  }
+  MappedRecordsHeader* header=new(base) MappedRecordsHeader;
+  header->recordSize=recordSize;
+  header->nrecords.store(0);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header->magic,mappedRecordsMagic,8);
+#else
+  plumed_merror("mapping files in memory requires plumed to be compiled with mmap");
+#endif
+}
+
+void MappedRecords::append(const std::vector<double>& record) {
+#ifdef __PLUMED_HAS_MMAP
+  plumed_dbg_assert(writer && record.size()==recordSize);
+  MappedRecordsHeader* header=getHeader(base);
+  unsigned long long n=header->nrecords.load(std::memory_order_relaxed);
+  size_t bytes=sizeof(double)*recordSize, end=headerSize+(n+1)*bytes;
+  if(end>mapped) {
+    size_t size=2*mapped; while(size<end) size*=2;
+    if(ftruncate(fd,size)!=0) plumed_merror("cannot resize file " + path);
+    map(size); header=getHeader(base);
+  }
+  std::memcpy(static_cast<char*>(base)+headerSize+n*bytes,record.data(),bytes);
+// the record is only visible to the readers once it is complete
+  header->nrecords.store(n+1,std::memory_order_release);
+  nread=n+1;
+#else
+  plumed_merror("mapping files in memory requires plumed to be compiled with mmap");
+#endif
+}
+
+bool MappedRecords::openRead(const std::string& p, unsigned n) {
+#ifdef __PLUMED_HAS_MMAP
+  plumed_massert(fd<0,"file " + path + " is already open");
+  path=p; recordSize=n; writer=false; nread=0;
+  fd=open(path.c_str(),O_RDONLY);
+  if(fd<0) return false;
+  struct stat st; fstat(fd,&st);
+  device=st.st_dev; inode=st.st_ino;
+  if(st.st_size>=static_cast<off_t>(headerSize)) {
+    map(st.st_size);
+    if(checkHeader()) return true;
+  }
+// the writer has not finished creating the file
+  close();
+  return false;
+#else
+  plumed_merror("mapping files in memory requires plumed to be compiled with mmap");
+#endif
+}
+
+unsigned MappedRecords::readNew(std::vector<double>& buffer) {
+#ifdef __PLUMED_HAS_MMAP
+  plumed_dbg_assert(!writer);
+  unsigned long long n=getHeader(base)->nrecords.load(std::memory_order_acquire);
+  if(n<=nread) return 0;
+  size_t bytes=sizeof(double)*recordSize, end=headerSize+n*bytes;
+  if(end>mapped) {
+// the writer has enlarged the file
+    struct stat st; fstat(fd,&st);
+    map(st.st_size);
+    plumed_massert(mapped>=end,"file " + path + " is shorter than expected");
+  }
+  const double* first=reinterpret_cast<const double*>(static_cast<char*>(base)+headerSize)+nread*recordSize;
+  buffer.insert(buffer.end(),first,first+(n-nread)*recordSize);
+  unsigned nnew=n-nread;
+  nread=n;
+  return nnew;
+#else
+  plumed_merror("mapping files in memory requires plumed to be compiled with mmap");
+#endif
+}
+
+bool MappedRecords::isReplaced() const {
+#ifdef __PLUMED_HAS_MMAP
+  struct stat st;
+  if(stat(path.c_str(),&st)!=0) return true;
+  return static_cast<unsigned long long>(st.st_dev)!=device || static_cast<unsigned long long>(st.st_ino)!=inode;
+#else
+  return false;
+#endif
+}
+
+unsigned long long MappedRecords::getNumberOfRecords() const {
+  plumed_assert(base);
+  return getHeader(base)->nrecords.load(std::memory_order_acquire);
+}
+
+void MappedRecords::close() {
+#ifdef __PLUMED_HAS_MMAP
+  if(base) munmap(base,mapped);
+  if(fd>=0) ::close(fd);
+#endif
+  base=NULL; mapped=0; fd=-1; nread=0;
+}
+
+}
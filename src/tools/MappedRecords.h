@@ -0,0 +1,102 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2018 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_tools_MappedRecords_h
+#define __PLUMED_tools_MappedRecords_h
+
+#include <string>
+#include <vector>
+
+namespace PLMD {
+
+/**
+\ingroup TOOLBOX
+Append-only binary file of fixed-size records that is mapped in memory.
+
+A single process appends records with append() while any number of other processes
+on the same node can open the same file with openRead() and get the records that
+were added since their last call to readNew(). Records are never parsed and, if the
+file is on a memory filesystem such as /dev/shm, no disk access is involved.
+The number of records is stored in the header of the file and it is only increased
+once a record has been completely written, so readers never see partial records.
+The file only grows so that readers can keep it mapped while it is written.
+
+This is only available when plumed is compiled with __PLUMED_HAS_MMAP.
+*/
+class MappedRecords {
+/// Copy constructor is disabled (private and unimplemented)
+  explicit MappedRecords(const MappedRecords&);
+/// Assignment operator is disabled (private and unimplemented)
+  MappedRecords& operator=(const MappedRecords&);
+/// Size of the header in bytes
+  static const size_t headerSize;
+/// Name of the file
+  std::string path;
+/// File descriptor, negative if the file is not open
+  int fd;
+/// Pointer to the mapped memory
+  void* base;
+/// Number of bytes currently mapped
+  size_t mapped;
+/// Number of doubles in each record
+  unsigned recordSize;
+/// Number of records read so far
+  unsigned long long nread;
+/// Device and inode of the open file, used to detect when it is replaced
+  unsigned long long device, inode;
+/// Is this object the one writing the file
+  bool writer;
+/// Map the first n bytes of the file
+  void map(size_t n);
+/// Check the header of a file opened for reading or appending.
+/// Returns false if the header has not been written yet.
+  bool checkHeader() const;
+public:
+  MappedRecords();
+  ~MappedRecords();
+/// Open the file for writing records of n doubles.
+/// If append is true and a file with the same record size exists, new records are added to it.
+/// Otherwise any existing file is removed first.
+  void openWrite(const std::string& path, unsigned n, bool append);
+/// Add a record at the end of the file
+  void append(const std::vector<double>& record);
+/// Open the file for reading records of n doubles. Returns false if the file does not exist yet.
+  bool openRead(const std::string& path, unsigned n);
+/// Append the records that have been added since the last call to buffer and return how many they are
+  unsigned readNew(std::vector<double>& buffer);
+/// Check if the file has been removed or replaced by a different one since it was opened
+  bool isReplaced() const;
+/// Total number of records in the file
+  unsigned long long getNumberOfRecords() const;
+/// Check if the file is open
+  bool isOpen() const;
+/// Unmap and close the file
+  void close();
+};
+
+inline
+bool MappedRecords::isOpen() const {
+  return fd>=0;
+}
+
+}
+
+#endif
@@ -24,17 +24,24 @@
 #include "Pbc.h"
 #include "AtomNumber.h"
 #include "Tools.h"
+#include "LinkCells.h"
+#include "Communicator.h"
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 namespace PLMD {
 using namespace std;
 
+/// Minimum number of possible pairs for which the neighbor list
+/// is rebuilt using link cells rather than looping over all pairs
+static const unsigned linkCellsMinPairs=1000;
+
 NeighborList::NeighborList(const vector<AtomNumber>& list0, const vector<AtomNumber>& list1,
                            const bool& do_pair, const bool& do_pbc, const Pbc& pbc,
                            const double& distance, const unsigned& stride): reduced(false),
   do_pair_(do_pair), do_pbc_(do_pbc), pbc_(&pbc),
-  distance_(distance), stride_(stride)
+  distance_(distance), skin_(0.0), stride_(stride)
 {
 // store full list of atoms needed
   fullatomlist_=list0;
@@ -56,7 +63,7 @@ NeighborList::NeighborList(const vector<AtomNumber>& list0, const bool& do_pbc,
                            const Pbc& pbc, const double& distance,
                            const unsigned& stride): reduced(false),
   do_pbc_(do_pbc), pbc_(&pbc),
-  distance_(distance), stride_(stride) {
+  distance_(distance), skin_(0.0), stride_(stride) {
   fullatomlist_=list0;
   nlist0_=list0.size();
   twolists_=false;
@@ -93,9 +100,24 @@ pair<unsigned,unsigned> NeighborList::getIndexPair(unsigned ipair) {
 
 void NeighborList::update(const vector<Vector>& positions) {
   neighbors_.clear();
-  const double d2=distance_*distance_;
 // check if positions array has the correct length
   plumed_assert(positions.size()==fullatomlist_.size());
+  if(useLinkCells()) updateLinkCells(positions);
+  else updateAllPairs(positions);
+// with a skin all the atoms are needed to monitor their displacements
+  if(skin_>0.0) reference_=positions;
+  else setRequestList();
+}
+
+bool NeighborList::useLinkCells() const {
+// with PAIR the number of pairs is already linear in the number of atoms
+  if(twolists_ && do_pair_) return false;
+// for small groups looping over all pairs is cheaper than binning
+  return nallpairs_>=linkCellsMinPairs;
+}
+
+void NeighborList::updateAllPairs(const vector<Vector>& positions) {
+  const double d2=(distance_+skin_)*(distance_+skin_);
   for(unsigned int i=0; i<nallpairs_; ++i) {
     pair<unsigned,unsigned> index=getIndexPair(i);
     unsigned index0=index.first;
@@ -109,7 +131,71 @@ void NeighborList::update(const vector<Vector>& positions) {
     double value=modulo2(distance);
     if(value<=d2) {neighbors_.push_back(index);}
   }
-  setRequestList();
+}
+
+void NeighborList::updateLinkCells(const vector<Vector>& positions) {
+  const double cutoff=distance_+skin_;
+  const double d2=cutoff*cutoff;
+  const unsigned natoms=positions.size();
+// With two lists only the atoms of the second list are binned and
+// the cells are then searched around each atom of the first list.
+// With a single list all atoms are binned.
+  const unsigned first=(twolists_ ? nlist0_ : 0);
+  const unsigned ncenters=(twolists_ ? nlist0_ : natoms);
+  vector<Vector> cellpos(positions.begin()+first,positions.end());
+  vector<unsigned> cellind(natoms-first);
+  for(unsigned i=0; i<cellind.size(); ++i) cellind[i]=first+i;
+
+// Without pbc the atoms are binned in an orthorhombic box
+// enclosing all of them, with a margin of one cutoff so that
+// periodic images of the cells can only add spurious candidates
+  Pbc cellpbc;
+  if(do_pbc_ && pbc_->isSet()) {
+    cellpbc.setBox(pbc_->getBox());
+  } else {
+    Vector lower=positions[0];
+    Vector upper=positions[0];
+    for(unsigned i=1; i<natoms; ++i) for(unsigned k=0; k<3; ++k) {
+        lower[k]=std::min(lower[k],positions[i][k]);
+        upper[k]=std::max(upper[k],positions[i][k]);
+      }
+    Tensor box;
+    for(unsigned k=0; k<3; ++k) box(k,k)=upper[k]-lower[k]+cutoff;
+    cellpbc.setBox(box);
+  }
+
+// Cells should be at least as large as the cutoff. They are made larger
+// when the system is so dilute that there would be more cells than atoms
+  double cellsize=std::cbrt(std::fabs(cellpbc.getBox().determinant())/natoms);
+  if(cellsize<cutoff) cellsize=cutoff;
+
+  Communicator serial;
+  LinkCells cells(serial);
+  cells.setCutoff(cellsize);
+  cells.buildCellLists(cellpos,cellind,cellpbc);
+
+  vector<unsigned> cells_required;
+  vector<unsigned> atoms(natoms+1);
+  vector<unsigned> close;
+  for(unsigned i=0; i<ncenters; ++i) {
+    unsigned natomsper=1; atoms[0]=i;
+    cells.retrieveNeighboringAtoms(positions[i],cells_required,natomsper,atoms);
+    close.clear();
+    for(unsigned k=1; k<natomsper; ++k) {
+      unsigned j=atoms[k];
+      if(!twolists_ && j<i) continue;
+      Vector distance;
+      if(do_pbc_) {
+        distance=pbc_->distance(positions[i],positions[j]);
+      } else {
+        distance=delta(positions[i],positions[j]);
+      }
+      if(modulo2(distance)<=d2) close.push_back(j);
+    }
+// pairs are stored in the same order as in updateAllPairs()
+    std::sort(close.begin(),close.end());
+    for(unsigned k=0; k<close.size(); ++k) neighbors_.push_back(pair<unsigned,unsigned>(i,close[k]));
+  }
 }
 
 void NeighborList::setRequestList() {
@@ -123,6 +209,7 @@ void NeighborList::setRequestList() {
 }
 
 vector<AtomNumber>& NeighborList::getReducedAtomList() {
+  if(skin_>0.0) return fullatomlist_;
   if(!reduced)for(unsigned int i=0; i<size(); ++i) {
       unsigned newindex0=0,newindex1=0;
       AtomNumber index0=fullatomlist_[neighbors_[i].first];
@@ -140,6 +227,31 @@ unsigned NeighborList::getStride() const {
   return stride_;
 }
 
+void NeighborList::setSkin(const double& skin) {
+  skin_=skin;
+  reference_.clear();
+}
+
+double NeighborList::getSkin() const {
+  return skin_;
+}
+
+bool NeighborList::isUpdateNeeded(const vector<Vector>& positions) const {
+  plumed_assert(skin_>0.0);
+  if(reference_.size()!=positions.size()) return true;
+  const double maxdisp2=0.25*skin_*skin_;
+  for(unsigned i=0; i<positions.size(); ++i) {
+    Vector displacement;
+    if(do_pbc_) {
+      displacement=pbc_->distance(reference_[i],positions[i]);
+    } else {
+      displacement=delta(reference_[i],positions[i]);
+    }
+    if(modulo2(displacement)>maxdisp2) return true;
+  }
+  return false;
+}
+
 unsigned NeighborList::getLastUpdate() const {
   return lastupdate_;
 }
@@ -40,8 +40,10 @@ class NeighborList
   const PLMD::Pbc* pbc_;
   std::vector<PLMD::AtomNumber> fullatomlist_,requestlist_;
   std::vector<std::pair<unsigned,unsigned> > neighbors_;
-  double distance_;
+  double distance_,skin_;
   unsigned stride_,nlist0_,nlist1_,nallpairs_,lastupdate_;
+/// Positions of the atoms at the last update, used with a skin
+  std::vector<PLMD::Vector> reference_;
 /// Initialize the neighbor list with all possible pairs
   void initialize();
 /// Return the pair of indexes in the positions array
@@ -49,6 +51,12 @@ class NeighborList
   std::pair<unsigned,unsigned> getIndexPair(unsigned i);
 /// Extract the list of atoms from the current list of close pairs
   void setRequestList();
+/// Check whether the neighbor list should be rebuilt using link cells
+  bool useLinkCells() const;
+/// Rebuild the neighbor list looping over all possible pairs
+  void updateAllPairs(const std::vector<PLMD::Vector>& positions);
+/// Rebuild the neighbor list binning the atoms in link cells
+  void updateLinkCells(const std::vector<PLMD::Vector>& positions);
 public:
   NeighborList(const std::vector<PLMD::AtomNumber>& list0,
                const std::vector<PLMD::AtomNumber>& list1,
@@ -68,6 +76,13 @@ public:
   void update(const std::vector<PLMD::Vector>& positions);
 /// Get the update stride of the neighbor list
   unsigned getStride() const;
+/// Set the skin of the neighbor list. When the skin is positive the list
+/// is built with cutoff+skin and contains all the requested atoms
+  void setSkin(const double& skin);
+/// Get the skin of the neighbor list
+  double getSkin() const;
+/// Check if some atom moved more than half the skin since the last update
+  bool isUpdateNeeded(const std::vector<PLMD::Vector>& positions) const;
 /// Get the last step in which the neighbor list was updated
   unsigned getLastUpdate() const;
 /// Set the step of the last update
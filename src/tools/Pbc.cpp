@@ -26,6 +26,7 @@
 #include <iostream>
 #include "Random.h"
 #include <cmath>
+#include <algorithm>
 
 namespace PLMD {
 
@@ -157,10 +158,14 @@ double Pbc::distance( const bool pbc, const Vector& v1, const Vector& v2 ) const
 
 void Pbc::apply(std::vector<Vector>& dlist, unsigned max_index) const {
   if (max_index==0) max_index=dlist.size();
+  if (max_index>0) apply(&dlist[0],max_index);
+}
+
+void Pbc::apply(Vector* dlist, unsigned n) const {
   if(type==unset) {
   } else if(type==orthorombic) {
 #ifdef __PLUMED_PBC_WHILE
-    for(unsigned k=0; k<max_index; ++k) {
+    for(unsigned k=0; k<n; ++k) {
       while(dlist[k][0]>hdiag[0])   dlist[k][0]-=diag[0];
       while(dlist[k][0]<=mdiag[0])  dlist[k][0]+=diag[0];
       while(dlist[k][1]>hdiag[1])   dlist[k][1]-=diag[1];
@@ -169,10 +174,47 @@ void Pbc::apply(std::vector<Vector>& dlist, unsigned max_index) const {
       while(dlist[k][2]<=mdiag[2])  dlist[k][2]+=diag[2];
     }
 #else
-    for(unsigned k=0; k<max_index; ++k) for(int i=0; i<3; i++) dlist[k][i]=Tools::pbc(dlist[k][i]*invBox(i,i))*box(i,i);
+// work directly on the array of components, so that the loop is easy to vectorize
+    const double b0=box(0,0), b1=box(1,1), b2=box(2,2);
+    const double i0=invBox(0,0), i1=invBox(1,1), i2=invBox(2,2);
+    double* d=&dlist[0][0];
+    for(unsigned k=0; k<n; ++k) {
+      d[3*k+0]=Tools::pbc(d[3*k+0]*i0)*b0;
+      d[3*k+1]=Tools::pbc(d[3*k+1]*i1)*b1;
+      d[3*k+2]=Tools::pbc(d[3*k+2]*i2)*b2;
+    }
 #endif
   } else if(type==generic) {
-    for(unsigned k=0; k<max_index; ++k) dlist[k]=distance(Vector(0.0,0.0,0.0),dlist[k]);
+// vectors are processed in blocks: first they are all brought to the reduced cell,
+// then the shifts are attempted only for those that are not obviously minimal
+    const unsigned blocksize=64;
+    int octant[blocksize];
+    for(unsigned start=0; start<n; start+=blocksize) {
+      const unsigned m=std::min(blocksize,n-start);
+      Vector* d=dlist+start;
+      for(unsigned k=0; k<m; ++k) {
+        Vector s=matmul(d[k],invReduced);
+        for(int i=0; i<3; i++) s[i]=Tools::pbc(s[i]);
+        d[k]=matmul(s,reduced);
+        if(std::fabs(s[0])+std::fabs(s[1])+std::fabs(s[2])>0.5) octant[k]=(s[0]>0?4:0)+(s[1]>0?2:0)+(s[2]>0?1:0);
+        else octant[k]=-1;
+      }
+      for(unsigned k=0; k<m; ++k) {
+        if(octant[k]<0) continue;
+        const std::vector<Vector> & myshifts(shifts[(octant[k]>>2)&1][(octant[k]>>1)&1][octant[k]&1]);
+        Vector best(d[k]);
+        double lbest(modulo2(best));
+        for(unsigned i=0; i<myshifts.size(); i++) {
+          Vector trial=d[k]+myshifts[i];
+          double ltrial=modulo2(trial);
+          if(ltrial<lbest) {
+            lbest=ltrial;
+            best=trial;
+          }
+        }
+        d[k]=best;
+      }
+    }
   } else plumed_merror("unknown pbc type");
 }
 
@@ -74,6 +74,12 @@ public:
   Vector distance(const Vector&,const Vector&,int*nshifts)const;
 /// Apply PBC to a set of positions or distance vectors
   void apply(std::vector<Vector>&dlist, unsigned max_index=0) const;
+/// Apply PBC to n contiguous distance vectors.
+/// This gives the same result as calling distance() on each of them, but
+/// orthorombic boxes are processed in a single loop over all the components and
+/// for generic boxes the scaled coordinates of a block of vectors are computed first,
+/// so that the search over shifts is done only for the vectors that need it.
+  void apply(Vector* dlist, unsigned n) const;
 /// Set the lattice vectors.
 /// b[i][j] is the j-th component of the i-th vector
   void setBox(const Tensor&b);
@@ -113,6 +113,14 @@ public:
   void setDisplace(const std::vector<double> & displace, bool normalize_weights=true);
 ///
   std::string getMethod();
+/// get the reference positions (with the center removed if it was asked in set())
+  const std::vector<Vector> & getReference() const {return reference;}
+/// get the (normalized) weights for alignment
+  const std::vector<double> & getAlign() const {return align;}
+/// get the (normalized) weights for deviation
+  const std::vector<double> & getDisplace() const {return displace;}
+/// check if the center of the reference has been removed
+  bool referenceCenterIsRemoved() const {return reference_center_is_removed;}
 /// workhorses
   double simpleAlignment(const  std::vector<double>  & align,
                          const  std::vector<double>  & displace,
@@ -22,7 +22,6 @@
 #include "SwitchingFunction.h"
 #include "Tools.h"
 #include "Keywords.h"
-#include "OpenMP.h"
 #include <vector>
 #include <limits>
 
@@ -161,6 +160,16 @@ removed in the future. Similarly, the STRETCH keyword is still allowed but has n
 Notice that switching functions defined with the simplified syntax are never stretched
 for backward compatibility. This might change in the future.
 
+Switching functions that require transcendental functions, and in particular those defined with MATHEVAL or CUSTOM,
+can be expensive when they are computed for a very large number of pairs. With the TABULATE keyword the function and its derivative are
+computed once on a grid of equally spaced points between \f$d_0\f$ and \f$d_{\textrm{max}}\f$ and then evaluated
+by cubic Hermite spline interpolation. The value of TABULATE is the number of intervals in the grid and D_MAX must be given.
+\verbatim
+KEYWORD={CUSTOM FUNC=exp(-x^2) R_0=0.5 D_MAX=2.0 TABULATE=1000}
+\endverbatim
+The largest interpolation errors on the function and on its derivative, estimated when the table is built, are reported
+in the description of the switching function that is written in the log.
+
 */
 //+ENDPLUMEDOC
 
@@ -186,6 +195,7 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
   dmax_2=std::numeric_limits<double>::max();
   stretch=1.0;
   shift=0.0;
+  ntable=0;
   init=true;
 
   bool present;
@@ -202,6 +212,9 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
   bool dontstretch=false;
   Tools::parseFlag(data,"NOSTRETCH",dontstretch); // this is ignored now
   if(dontstretch) dostretch=false;
+  unsigned tabulate=0;
+  present=Tools::findKeyword(data,"TABULATE");
+  if(present && !Tools::parse(data,"TABULATE",tabulate)) errormsg="could not parse TABULATE";
   double r0;
   if(name=="CUBIC") {
     r0 = dmax - d0;
@@ -252,11 +265,10 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
     Tools::parse(data,"FUNC",func);
     lepton::ParsedExpression pe=lepton::Parser::parse(func).optimize(leptonConstants);
     lepton_func=func;
-    expression.resize(OpenMP::getNumThreads());
-    for(auto & e : expression) e=pe.createCompiledExpression();
+    expression=pe.createCompiledExpression();
     lepton::ParsedExpression ped=lepton::Parser::parse(func).differentiate("x").optimize(leptonConstants);
-    expression_deriv.resize(OpenMP::getNumThreads());
-    for(auto & e : expression_deriv) e=ped.createCompiledExpression();
+    expression_deriv=ped.createCompiledExpression();
+    for(const auto & v : expression.getVariables()) if(v!="x") errormsg="the only variable allowed in FUNC is x, found "+v;
   }
   else errormsg="cannot understand switching function type '"+name+"'";
   if( !data.empty() ) {
@@ -271,6 +283,59 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
     stretch=1.0/(s0-sd);
     shift=-sd*stretch;
   }
+
+  if(tabulate>0) {
+    if(dmax==std::numeric_limits<double>::max()) errormsg="TABULATE requires D_MAX";
+    else setupTable(tabulate);
+  }
+}
+
+void SwitchingFunction::setupTable(unsigned n) {
+// the table is filled with the exact function, so tabulation is switched on only at the end
+  ntable=0;
+  table_dx=(dmax-d0)/n;
+  table_idx=1.0/table_dx;
+  table_val.resize(n+1);
+  table_der.resize(n+1);
+  for(unsigned k=0; k<=n; ++k) {
+    double r=d0+k*table_dx;
+// the function can have a kink in d0, so its derivative is taken just above it
+    if(k==0) r+=1e-9*table_dx;
+    double df;
+    table_val[k]=calculate(r,df);
+    table_der[k]=df*r;
+  }
+// estimate the interpolation error within each interval
+  table_error=0.0;
+  table_derror=0.0;
+  for(unsigned k=0; k<n; ++k) for(unsigned j=1; j<4; ++j) {
+      double r=d0+(k+0.25*j)*table_dx, df, dft;
+      double err=std::fabs(calculate(r,df)-do_table(r,dft));
+      double derr=std::fabs(df-dft)*r;
+      if(err>table_error) table_error=err;
+      if(derr>table_derror) table_derror=derr;
+    }
+  ntable=n;
+}
+
+double SwitchingFunction::do_table(double distance,double&dfunc)const {
+  if(distance<=d0) {
+    dfunc=0.0;
+    return table_val[0];
+  }
+  const unsigned n=table_val.size()-1;
+  const double x=(distance-d0)*table_idx;
+  unsigned k=static_cast<unsigned>(x);
+  if(k>=n) k=n-1;
+  const double t=x-k, t2=t*t, t3=t2*t;
+// cubic Hermite basis functions and their derivatives wrt t
+  const double h00=2*t3-3*t2+1, h10=t3-2*t2+t, h01=-2*t3+3*t2, h11=t3-t2;
+  const double d00=6*t2-6*t, d10=3*t2-4*t+1, d01=-6*t2+6*t, d11=3*t2-2*t;
+  const double m0=table_dx*table_der[k], m1=table_dx*table_der[k+1];
+  const double result=h00*table_val[k]+h10*m0+h01*table_val[k+1]+h11*m1;
+// calculate() returns the derivative divided by the distance
+  dfunc=(d00*table_val[k]+d10*m0+d01*table_val[k+1]+d11*m1)*table_idx/distance;
+  return result;
 }
 
 std::string SwitchingFunction::description() const {
@@ -308,6 +373,9 @@ std::string SwitchingFunction::description() const {
     ostr<<" func="<<lepton_func;
 
   }
+  if(ntable>0) {
+    ostr<<" tabulated on "<<ntable<<" intervals (max error "<<table_error<<", on the derivative "<<table_derror<<")";
+  }
   return ostr.str();
 }
 
@@ -337,7 +405,7 @@ double SwitchingFunction::do_rational(double rdist,double&dfunc,int nn,int mm)co
 }
 
 double SwitchingFunction::calculateSqr(double distance2,double&dfunc)const {
-  if(type==rational && nn%2==0 && mm%2==0 && d0==0.0) {
+  if(type==rational && nn%2==0 && mm%2==0 && d0==0.0 && ntable==0) {
     if(distance2>dmax_2) {
       dfunc=0.0;
       return 0.0;
@@ -362,6 +430,7 @@ double SwitchingFunction::calculate(double distance,double&dfunc)const {
     dfunc=0.0;
     return 0.0;
   }
+  if(ntable>0) return do_table(distance,dfunc);
   const double rdist = (distance-d0)*invr0;
   double result;
 
@@ -395,17 +464,7 @@ double SwitchingFunction::calculate(double distance,double&dfunc)const {
       result = 1.0 - tmp1;
       dfunc=-(1-tmp1*tmp1);
     } else if(type==leptontype) {
-      const unsigned t=OpenMP::getThreadNum();
-      plumed_assert(t<expression.size());
-      try {
-        const_cast<lepton::CompiledExpression*>(&expression[t])->getVariableReference("x")=rdist;
-        const_cast<lepton::CompiledExpression*>(&expression_deriv[t])->getVariableReference("x")=rdist;
-      } catch(PLMD::lepton::Exception& exc) {
-// this is necessary since in some cases lepton things a variable is not present even though it is present
-// e.g. func=0*x
-      }
-      result=expression[t].evaluate();
-      dfunc=expression_deriv[t].evaluate();
+      do_lepton(1,&rdist,&result,&dfunc);
     } else plumed_merror("Unknown switching function type");
 // this is for the chain rule:
     dfunc*=invr0;
@@ -420,6 +479,59 @@ double SwitchingFunction::calculate(double distance,double&dfunc)const {
   return result;
 }
 
+void SwitchingFunction::do_lepton(unsigned n,const double*rdist,double*result,double*dfunc)const {
+// x is the only variable. In some cases lepton optimizes it away (e.g. func=0*x),
+// so that the expression has no variables at all and vars is not read.
+// The derivative is evaluated first so that result can be the same array as rdist
+  const double* vars[1]= {rdist};
+  expression_deriv.evaluate(n,vars,dfunc);
+  expression.evaluate(n,vars,result);
+}
+
+void SwitchingFunction::do_lepton(unsigned n,const double*x,bool squared,double*result,double*dfunc)const {
+// result is used to store the scaled distances, so that no temporary is needed
+  for(unsigned i=0; i<n; ++i) result[i]=((squared?std::sqrt(x[i]):x[i])-d0)*invr0;
+  do_lepton(n,result,result,dfunc);
+  for(unsigned i=0; i<n; ++i) {
+    const double distance=(squared?std::sqrt(x[i]):x[i]);
+    if(distance>dmax) {
+      result[i]=0.0; dfunc[i]=0.0;
+    } else if((distance-d0)*invr0<=0.) {
+      result[i]=stretch+shift; dfunc[i]=0.0;
+    } else {
+// chain rule and division by distance as in calculate()
+      result[i]=result[i]*stretch+shift;
+      dfunc[i]=dfunc[i]*invr0/distance*stretch;
+    }
+  }
+}
+
+void SwitchingFunction::calculate(const std::vector<double>& distance,std::vector<double>& result,std::vector<double>& dfunc)const {
+  plumed_massert(init,"you are trying to use an unset SwitchingFunction");
+  const unsigned n=distance.size();
+  result.resize(n); dfunc.resize(n);
+  if(!hasBatchedEvaluation()) {
+    for(unsigned i=0; i<n; ++i) result[i]=calculate(distance[i],dfunc[i]);
+  } else if(n>0) {
+    do_lepton(n,&distance[0],false,&result[0],&dfunc[0]);
+  }
+}
+
+void SwitchingFunction::calculateSqr(const std::vector<double>& distance2,std::vector<double>& result,std::vector<double>& dfunc)const {
+  plumed_massert(init,"you are trying to use an unset SwitchingFunction");
+  const unsigned n=distance2.size();
+  result.resize(n); dfunc.resize(n);
+  if(!hasBatchedEvaluation()) {
+    for(unsigned i=0; i<n; ++i) result[i]=calculateSqr(distance2[i],dfunc[i]);
+  } else if(n>0) {
+    do_lepton(n,&distance2[0],true,&result[0],&dfunc[0]);
+  }
+}
+
+bool SwitchingFunction::hasBatchedEvaluation()const {
+  return type==leptontype && ntable==0;
+}
+
 SwitchingFunction::SwitchingFunction():
   init(false),
   type(rational),
@@ -438,7 +550,12 @@ SwitchingFunction::SwitchingFunction():
   invr0_2(0.0),
   dmax_2(0.0),
   stretch(1.0),
-  shift(0.0)
+  shift(0.0),
+  ntable(0),
+  table_dx(0.0),
+  table_idx(0.0),
+  table_error(0.0),
+  table_derror(0.0)
 {
 }
 
@@ -460,7 +577,17 @@ SwitchingFunction::SwitchingFunction(const SwitchingFunction&sf):
   invr0_2(sf.invr0_2),
   dmax_2(sf.dmax_2),
   stretch(sf.stretch),
-  shift(sf.shift)
+  shift(sf.shift),
+  lepton_func(sf.lepton_func),
+  expression(sf.expression),
+  expression_deriv(sf.expression_deriv),
+  ntable(sf.ntable),
+  table_dx(sf.table_dx),
+  table_idx(sf.table_idx),
+  table_val(sf.table_val),
+  table_der(sf.table_der),
+  table_error(sf.table_error),
+  table_derror(sf.table_derror)
 {
 }
 
@@ -484,6 +611,16 @@ SwitchingFunction & SwitchingFunction::operator=(const SwitchingFunction& sf) {
   dmax_2=sf.dmax_2;
   stretch=sf.stretch;
   shift=sf.shift;
+  lepton_func=sf.lepton_func;
+  expression=sf.expression;
+  expression_deriv=sf.expression_deriv;
+  ntable=sf.ntable;
+  table_dx=sf.table_dx;
+  table_idx=sf.table_idx;
+  table_val=sf.table_val;
+  table_der=sf.table_der;
+  table_error=sf.table_error;
+  table_derror=sf.table_derror;
   return *this;
 }
 
@@ -491,6 +628,7 @@ SwitchingFunction & SwitchingFunction::operator=(const SwitchingFunction& sf) {
 void SwitchingFunction::set(int nn,int mm,double r0,double d0) {
   init=true;
   type=rational;
+  ntable=0;
   if(mm==0) mm=2*nn;
   this->nn=nn;
   this->mm=mm;
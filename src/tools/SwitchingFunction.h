@@ -70,11 +70,26 @@ class SwitchingFunction {
 /// Function for lepton;
   std::string lepton_func;
 /// Lepton expression.
-/// \warning Since lepton::CompiledExpression is mutable, a vector is necessary for multithreading!
-  std::vector<lepton::CompiledExpression> expression;
+/// It is only evaluated with the batched (and thread safe) lepton::CompiledExpression::evaluate()
+  lepton::CompiledExpression expression;
 /// Lepton expression for derivative
-/// \warning Since lepton::CompiledExpression is mutable, a vector is necessary for multithreading!
-  std::vector<lepton::CompiledExpression> expression_deriv;
+  lepton::CompiledExpression expression_deriv;
+/// Evaluate the lepton expressions for n scaled distances (result can be the same array as rdist)
+  void do_lepton(unsigned n,const double*rdist,double*result,double*dfunc)const;
+/// Compute the switching function with lepton for n (possibly squared) distances
+  void do_lepton(unsigned n,const double*x,bool squared,double*result,double*dfunc)const;
+/// Number of intervals in the table (0 if the function is not tabulated)
+  unsigned ntable;
+/// Spacing of the table and its inverse
+  double table_dx,table_idx;
+/// Tabulated values and derivatives (wrt the distance) of the function
+  std::vector<double> table_val,table_der;
+/// Estimated maximum interpolation errors on the function and on its derivative
+  double table_error,table_derror;
+/// Build the table with n intervals between d0 and dmax
+  void setupTable(unsigned n);
+/// Compute the function by cubic Hermite interpolation of the table
+  double do_table(double distance,double&dfunc)const;
 public:
   static void registerKeywords( Keywords& keys );
 /// Constructor
@@ -104,6 +119,16 @@ public:
 /// The advantage is that in some case the expensive square root can be avoided
 /// (namely for rational functions, if nn and mm are even and d0 is zero)
   double calculateSqr(double distance2,double&dfunc)const;
+/// Compute the switching function for many distances at once.
+/// Equivalent to calling calculate() for each element of x, but
+/// functions defined with CUSTOM are evaluated for all the distances
+/// together, which is much faster.
+  void calculate(const std::vector<double>& x,std::vector<double>& result,std::vector<double>& df)const;
+/// Same as the previous one, but taking the squared distances (see calculateSqr()).
+  void calculateSqr(const std::vector<double>& distance2,std::vector<double>& result,std::vector<double>& dfunc)const;
+/// True if the vector versions of calculate() and calculateSqr() are faster than
+/// calling the scalar ones in a loop (i.e. for non tabulated CUSTOM functions)
+  bool hasBatchedEvaluation()const;
 /// Returns d0
   double get_d0() const;
 /// Returns r0
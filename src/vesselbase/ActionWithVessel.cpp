@@ -280,10 +280,22 @@ void ActionWithVessel::runAllTasks() {
   // std::vector<double> buffer( bufsize, 0.0 );
 
   if(timers) stopwatch.start("2 Loop over tasks");
+  // The thread buffers are kept across steps and are left zeroed by the reduction
+  if( nt>1 ) {
+    unsigned nder=getNumberOfDerivatives();
+    if( omp_buffers.size()<nt ) { omp_buffers.resize( nt ); omp_active.resize( nt ); omp_isactive.resize( nt ); }
+    for(unsigned t=0; t<nt; ++t) {
+      if( omp_buffers[t].size()!=bufsize ) omp_buffers[t].assign( bufsize, 0.0 );
+      if( omp_isactive[t].size()!=nder ) { omp_isactive[t].assign( nder, 0 ); omp_active[t].resize(0); }
+    }
+    setupThreadReduction( bufsize );
+  }
+
   #pragma omp parallel num_threads(nt)
   {
-    std::vector<double> omp_buffer;
-    if( nt>1 ) omp_buffer.resize( bufsize, 0.0 );
+    const unsigned tid=OpenMP::getThreadNum();
+    std::vector<double>& omp_buffer=( nt>1 ? omp_buffers[tid] : buffer );
+    const bool trackder=( nt>1 && omp_rows.size()>0 );
     MultiValue myvals( getNumberOfQuantities(), getNumberOfDerivatives() );
     MultiValue bvals( getNumberOfQuantities(), getNumberOfDerivatives() );
     myvals.clearAll(); bvals.clearAll();
@@ -305,17 +317,14 @@ void ActionWithVessel::runAllTasks() {
       // Now calculate all the functions
       // If the contribution of this quantity is very small at neighbour list time ignore it
       // untill next neighbour list time
-      if( nt>1 ) {
-        calculateAllVessels( indexOfTaskInFullList[i], myvals, bvals, omp_buffer, der_list );
-      } else {
-        calculateAllVessels( indexOfTaskInFullList[i], myvals, bvals, buffer, der_list );
-      }
+      calculateAllVessels( indexOfTaskInFullList[i], myvals, bvals, omp_buffer, der_list );
+      // Remember the derivatives that this thread has added to its buffer
+      if( trackder ) recordActiveDerivatives( tid, myvals );
 
       // Clear the value
       myvals.clearAll();
     }
-    #pragma omp critical
-    if(nt>1) for(unsigned i=0; i<bufsize; ++i) buffer[i]+=omp_buffer[i];
+    if( nt>1 ) reduceThreadBuffers( nt );
   }
   if(timers) stopwatch.stop("2 Loop over tasks");
   // Turn back on derivative calculation
@@ -337,6 +346,74 @@ void ActionWithVessel::runAllTasks() {
   if(timers) stopwatch.stop("4 Finishing computations");
 }
 
+void ActionWithVessel::setupThreadReduction( const unsigned& bufsize ) {
+  // Vessels whose buffer is made of rows holding a value and its derivatives accumulate
+  // them with MultiValue::chainRule, so only the derivatives that are active in some task
+  // have to be reduced. The rest of the buffer is reduced in blocks.
+  const unsigned nder=getNumberOfDerivatives(), blocksize=1024;
+  omp_rows.resize(0); omp_blocks.resize(0);
+  unsigned dense=0;
+  for(unsigned j=0; j<functions.size(); ++j) {
+    unsigned start=functions[j]->bufstart, size=functions[j]->getSizeOfBuffer();
+    unsigned nrows=functions[j]->getNumberOfDerivativeRows();
+    if( nrows==0 || nrows*(1+nder)!=size ) continue;
+    for(unsigned b=dense; b<start; b+=blocksize) omp_blocks.push_back( std::pair<unsigned,unsigned>( b, std::min(b+blocksize,start) ) );
+    for(unsigned r=0; r<nrows; ++r) omp_rows.push_back( start + r*(1+nder) );
+    dense=start+size;
+  }
+  for(unsigned b=dense; b<bufsize; b+=blocksize) omp_blocks.push_back( std::pair<unsigned,unsigned>( b, std::min(b+blocksize,bufsize) ) );
+}
+
+void ActionWithVessel::recordActiveDerivatives( const unsigned& tid, MultiValue& myvals ) {
+  if( !myvals.updateComplete() ) myvals.updateDynamicList();
+  std::vector<unsigned>& active=omp_active[tid];
+  std::vector<char>& isactive=omp_isactive[tid];
+  for(unsigned i=0; i<myvals.getNumberActive(); ++i) {
+    unsigned jder=myvals.getActiveIndex(i);
+    if( !isactive[jder] ) { isactive[jder]=1; active.push_back( jder ); }
+  }
+}
+
+void ActionWithVessel::reduceThreadBuffers( const unsigned& nt ) {
+  // Wait for all the threads to finish their tasks
+  #pragma omp barrier
+  // Merge the derivatives touched by all the threads in the list of the first thread
+  #pragma omp single
+  {
+    for(unsigned t=1; t<nt; ++t) {
+      for(unsigned i=0; i<omp_active[t].size(); ++i) {
+        unsigned jder=omp_active[t][i]; omp_isactive[t][jder]=0;
+        if( !omp_isactive[0][jder] ) { omp_isactive[0][jder]=1; omp_active[0].push_back( jder ); }
+      }
+      omp_active[t].resize(0);
+    }
+  }
+  // Each thread sums different elements of the buffer over all the threads, so no
+  // critical section is needed. Thread buffers are zeroed for the next step.
+  #pragma omp for nowait
+  for(unsigned b=0; b<omp_blocks.size(); ++b) {
+    for(unsigned t=0; t<nt; ++t) {
+      double* tbuf=omp_buffers[t].data();
+      for(unsigned i=omp_blocks[b].first; i<omp_blocks[b].second; ++i) {
+        if( tbuf[i]!=0.0 ) { buffer[i]+=tbuf[i]; tbuf[i]=0.0; }
+      }
+    }
+  }
+  // In the rows only the values and the active derivatives can be non zero
+  const std::vector<unsigned>& active=omp_active[0];
+  const unsigned nentries=1+active.size();
+  #pragma omp for
+  for(unsigned k=0; k<omp_rows.size()*nentries; ++k) {
+    unsigned ientry=k%nentries, i=omp_rows[k/nentries] + ( ientry==0 ? 0 : 1+active[ientry-1] );
+    for(unsigned t=0; t<nt; ++t) { buffer[i]+=omp_buffers[t][i]; omp_buffers[t][i]=0.0; }
+  }
+  #pragma omp single
+  {
+    for(unsigned i=0; i<omp_active[0].size(); ++i) omp_isactive[0][ omp_active[0][i] ]=0;
+    omp_active[0].resize(0);
+  }
+}
+
 void ActionWithVessel::transformBridgedDerivatives( const unsigned& current, MultiValue& invals, MultiValue& outvals ) const {
   plumed_error();
 }
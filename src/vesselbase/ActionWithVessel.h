@@ -85,6 +85,22 @@ private:
   std::vector<unsigned> der_list;
 /// The buffer that we use (we keep a copy here to avoid resizing)
   std::vector<double> buffer;
+/// The buffers used by each OpenMP thread (kept here to avoid reallocating them at every step)
+  std::vector<std::vector<double> > omp_buffers;
+/// The derivatives that each OpenMP thread has accumulated in its buffer (as a list and as flags)
+  std::vector<std::vector<unsigned> > omp_active;
+  std::vector<std::vector<char> > omp_isactive;
+/// The start of the rows of the buffer that hold a value followed by its derivatives.
+/// Only the entries of the active derivatives are reduced over the threads for these
+  std::vector<unsigned> omp_rows;
+/// The ranges of the buffer that are reduced over the threads element by element
+  std::vector<std::pair<unsigned,unsigned> > omp_blocks;
+/// Decide how each part of the buffer is reduced over the threads
+  void setupThreadReduction( const unsigned& bufsize );
+/// Add the derivatives that are active in myvals to those accumulated by a thread
+  void recordActiveDerivatives( const unsigned& tid, MultiValue& myvals );
+/// Add the buffers of the OpenMP threads to buffer and zero them (called by every thread in the team)
+  void reduceThreadBuffers( const unsigned& nt );
 /// Do we want to output information on the timings of different parts of the calculation
   bool timers;
   ForwardDecl<Stopwatch> stopwatch_fwd;
@@ -162,6 +178,8 @@ public:
   virtual unsigned getNumberOfDerivatives()=0;
 /// Get the number of quantities that are calculated during each task
   virtual unsigned getNumberOfQuantities() const ;
+/// Check if a quantity that can be selected with the COMPONENT keyword of the vessels is calculated
+  virtual bool isComponentCalculated( const unsigned& icomp ) const { return true; }
 /// Get the number of vessels
   unsigned getNumberOfVessels() const;
 /// Get a pointer to the ith vessel
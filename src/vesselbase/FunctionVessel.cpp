@@ -49,6 +49,11 @@ void FunctionVessel::resize() {
   }
 }
 
+unsigned FunctionVessel::getNumberOfDerivativeRows() const {
+  if( !getAction()->derivativesAreRequired() ) return 0;
+  return getSizeOfBuffer() / ( 1 + getAction()->getNumberOfDerivatives() );
+}
+
 void FunctionVessel::calculate( const unsigned& current, MultiValue& myvals, std::vector<double>& buffer, std::vector<unsigned>& der_list ) const {
   unsigned nderivatives=getFinalValue()->getNumberOfDerivatives();
   double weight=myvals.get(0);
@@ -51,6 +51,8 @@ public:
   explicit FunctionVessel( const VesselOptions& );
 /// This does the resizing of the buffer
   virtual void resize();
+/// The buffer holds rows with a value and its derivatives if derivatives are required
+  unsigned getNumberOfDerivativeRows() const ;
 /// Do the calcualtion
   virtual void calculate( const unsigned& current, MultiValue& myvals, std::vector<double>& buffer, std::vector<unsigned>& der_list ) const ;
 /// Do any transformations of the value that are required
@@ -84,6 +84,9 @@ Moments::Moments( const vesselbase::VesselOptions& da) :
     Tools::interpretRanges(moments); mycomponent=1;
   } else {
     std::string numstr; parse("COMPONENT",mycomponent);
+    if( !getAction()->isComponentCalculated( mycomponent ) ) {
+      Tools::convert( mycomponent, numstr ); error("component " + numstr + " is not calculated by this action");
+    }
     Tools::convert( mycomponent, numstr); valstr = "moment-"  + numstr + "-";
     parseVector("MOMENTS",moments); Tools::interpretRanges(moments);
   }
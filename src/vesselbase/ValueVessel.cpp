@@ -20,6 +20,7 @@
    along with plumed.  If not, see <http://www.gnu.org/licenses/>.
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 #include "ValueVessel.h"
+#include "ActionWithVessel.h"
 
 namespace PLMD {
 namespace vesselbase {
@@ -34,6 +35,10 @@ ValueVessel::ValueVessel( const VesselOptions& da ):
   no_output_value(false)
 {
   parse("COMPONENT",mycomp);
+  if( !getAction()->isComponentCalculated( mycomp ) ) {
+    std::string compstr; Tools::convert( mycomp, compstr );
+    error("component " + compstr + " is not calculated by this action");
+  }
   ActionWithValue* a=dynamic_cast<ActionWithValue*>( getAction() );
   plumed_massert(a,"cannot create passable values as base action does not inherit from ActionWithValue");
   int numval = getNumericalLabel();
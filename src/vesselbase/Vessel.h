@@ -153,6 +153,9 @@ public:
   virtual void finish( const std::vector<double>& )=0;
 /// Reset the size of the buffers
   virtual void resize()=0;
+/// Return the number of rows of (1+nder) elements, a value followed by its derivatives, that
+/// make up the buffer of this vessel (zero if the buffer is organised in some other way)
+  virtual unsigned getNumberOfDerivativeRows() const { return 0; }
 /// Retrieve the forces on the quantities in the vessel
   virtual bool applyForce( std::vector<double>& forces )=0;
 };